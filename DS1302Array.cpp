@@ -0,0 +1,213 @@
+// DS1302 array
+// ------------
+//
+// The bus sequence is the same as for a single chip (see
+// DS1302RTC.cpp), but the command is written to all I/O-lines
+// at once, and every data bit is sampled from all of them.
+//
+// Without DS1302RTC_FASTIO, or with the I/O-lines on different
+// ports, the lines are read one after the other with
+// digitalRead() in the same clock low time.
+//
+
+#include <Arduino.h>
+#include "DS1302Array.h"
+
+DS1302Array::DS1302Array(uint8_t _sclk, uint8_t _rst, const uint8_t *_io, uint8_t count)
+ { uint8_t i;
+
+   sclk = _sclk;
+   rst = _rst;
+   io = _io;
+   n = count > DS1302_ARRAY_MAX ? DS1302_ARRAY_MAX : count;
+
+#ifdef DS1302RTC_FASTIO
+   samePort = true;
+   ioAll = 0;
+   for (i = 0; i < n; i++)
+    { if (digitalPinToPort(io[i]) != digitalPinToPort(io[0]))
+         samePort = false;
+      ioMask[i] = digitalPinToBitMask(io[i]);
+      ioAll |= ioMask[i];
+    }
+   ioPort = portOutputRegister(digitalPinToPort(io[0]));
+   ioPin = portInputRegister(digitalPinToPort(io[0]));
+   ioDdr = portModeRegister(digitalPinToPort(io[0]));
+   sclkPort = portOutputRegister(digitalPinToPort(sclk));
+   sclkMask = digitalPinToBitMask(sclk);
+#else
+   (void) i;
+#endif
+ }
+
+// Read the time of every chip into t[0] .. t[count - 1].
+// Bit i of the result is set when chip i gave a valid time,
+// t[i] is 0 and tm[i] is not changed when it didn't.
+uint8_t DS1302Array::read(time_t *t)
+ { uint8_t regs[DS1302_ARRAY_MAX][8];
+   uint8_t i, ok;
+
+   clock_burst_read(regs);
+   ok = 0;
+   for (i = 0; i < n; i++)
+    { if (DS1302RTC::valid(regs[i]))
+       { t[i] = DS1302RTC::epoch(regs[i]);
+         ok |= bit(i);
+       }
+      else
+         t[i] = 0;
+    }
+   return ok;
+ }
+
+uint8_t DS1302Array::read(tmElements_t *tm)
+ { uint8_t regs[DS1302_ARRAY_MAX][8];
+   uint8_t i, ok;
+
+   clock_burst_read(regs);
+   ok = 0;
+   for (i = 0; i < n; i++)
+    { if (DS1302RTC::valid(regs[i]))
+       { DS1302RTC::decode(regs[i], tm[i]);
+         ok |= bit(i);
+       }
+    }
+   return ok;
+ }
+
+
+// --------------------------------------------------------
+// DS1302Array::clock_burst_read
+//
+// One clock burst read on all chips.
+//
+void DS1302Array::clock_burst_read(uint8_t regs[][8])
+ { uint8_t i, j, k, bits, command;
+
+   digitalWrite(rst, LOW);
+   pinMode(rst, OUTPUT);
+   digitalWrite(sclk, LOW);
+   pinMode(sclk, OUTPUT);
+   ioOutput(true);
+
+   digitalWrite(rst, HIGH);
+   DS1302_DELAY_TCC();
+
+   // The CLOCK_BURST_READ command on all I/O-lines,
+   // release the lines after the last bit.
+   command = DS1302_CLOCK_BURST_READ;
+   for (i = 0; i <= 7; i++)
+    { ioWrite(bitRead(command, i));
+      DS1302_DELAY_TDC();
+      sclkWrite(HIGH);
+      DS1302_DELAY_TCH();
+
+      if (i == 7)
+         ioOutput(false);
+      else
+       { sclkWrite(LOW);
+         DS1302_DELAY_TCL();
+       }
+    }
+
+   memset(regs, 0, n * 8);
+   for (k = 0; k < 8; k++)
+    { for (i = 0; i <= 7; i++)
+       { sclkWrite(HIGH);
+         DS1302_DELAY_TCH();
+         sclkWrite(LOW);
+         DS1302_DELAY_TCL();
+
+         // one bit of every chip
+         bits = ioRead();
+         for (j = 0; j < n; j++)
+            if (bitRead(bits, j))
+               regs[j][k] |= bit(i);
+       }
+    }
+
+   digitalWrite(rst, LOW);
+   DS1302_DELAY_TCWH();
+ }
+
+
+// --------------------------------------------------------
+// DS1302Array I/O-line helpers
+//
+// ioRead() returns bit j set for a high I/O-line of chip j.
+//
+void DS1302Array::sclkWrite(uint8_t value)
+ {
+#ifdef DS1302RTC_FASTIO
+   uint8_t oldSREG = SREG;
+   cli();
+   if (value)
+      *sclkPort |= sclkMask;
+   else
+      *sclkPort &= ~sclkMask;
+   SREG = oldSREG;
+#else
+   digitalWrite(sclk, value);
+#endif
+ }
+
+void DS1302Array::ioWrite(uint8_t value)
+ { uint8_t j;
+
+#ifdef DS1302RTC_FASTIO
+   if (samePort)
+    { uint8_t oldSREG = SREG;
+      cli();
+      if (value)
+         *ioPort |= ioAll;
+      else
+         *ioPort &= ~ioAll;
+      SREG = oldSREG;
+      return;
+    }
+#endif
+   for (j = 0; j < n; j++)
+      digitalWrite(io[j], value);
+ }
+
+void DS1302Array::ioOutput(bool on)
+ { uint8_t j;
+
+#ifdef DS1302RTC_FASTIO
+   if (samePort)
+    { uint8_t oldSREG = SREG;
+      cli();
+      if (on)
+         *ioDdr |= ioAll;
+      else
+       { *ioDdr &= ~ioAll;
+         *ioPort &= ~ioAll;     // no pull-ups
+       }
+      SREG = oldSREG;
+      return;
+    }
+#endif
+   for (j = 0; j < n; j++)
+      pinMode(io[j], on ? OUTPUT : INPUT);
+ }
+
+uint8_t DS1302Array::ioRead(void)
+ { uint8_t j, bits;
+
+#ifdef DS1302RTC_FASTIO
+   if (samePort)
+    { uint8_t sample = *ioPin;   // one read for all chips
+
+      bits = 0;
+      for (j = 0; j < n; j++)
+         if (sample & ioMask[j])
+            bits |= bit(j);
+      return bits;
+    }
+#endif
+   bits = 0;
+   for (j = 0; j < n; j++)
+      if (digitalRead(io[j]))
+         bits |= bit(j);
+   return bits;
+ }
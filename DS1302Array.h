@@ -0,0 +1,53 @@
+/*
+ * DS1302Array.h - read up to 8 DS1302 chips at the same time
+ *
+ * The chips share the SCLK and CE lines, and each chip has
+ * its own I/O-line. With the I/O-lines on the same port,
+ * every clock edge needs only one port read for all chips,
+ * so all chips are read in the time of one:
+ *    const uint8_t io[] = { 2, 3, 4, 5 };   // PORTD on an Uno
+ *    DS1302Array clocks(6, 7, io, 4);       // sclk, rst
+ */
+
+#ifndef DS1302Array_h
+#define DS1302Array_h
+
+#include "DS1302RTC.h"
+
+#define DS1302_ARRAY_MAX 8
+
+class DS1302Array
+ { public:
+      DS1302Array(uint8_t sclk, uint8_t rst, const uint8_t *io, uint8_t count);
+
+      uint8_t count() const { return n; }
+      // Bit i is set when chip i is valid.
+      uint8_t read(time_t *t);
+      uint8_t read(tmElements_t *tm);
+
+   private:
+      void clock_burst_read(uint8_t regs[][8]);
+      void sclkWrite(uint8_t value);
+      void ioWrite(uint8_t value);
+      void ioOutput(bool on);
+      uint8_t ioRead(void);
+
+      uint8_t sclk;
+      uint8_t rst;
+      const uint8_t *io;
+      uint8_t n;
+
+#ifdef DS1302RTC_FASTIO
+      // Set when all I/O-lines are on the same port.
+      bool samePort;
+      volatile uint8_t *ioPort;
+      volatile uint8_t *ioPin;
+      volatile uint8_t *ioDdr;
+      uint8_t ioMask[DS1302_ARRAY_MAX];
+      uint8_t ioAll;
+      volatile uint8_t *sclkPort;
+      uint8_t sclkMask;
+#endif
+ };
+
+#endif
@@ -0,0 +1,139 @@
+// DS1302 batch
+// ------------
+//
+// The writes of a batch are made in this order:
+//    1. clear the Write Protect, if it isn't known to be cleared
+//    2. the single writes, in the order they were added
+//    3. the ram burst
+//    4. the clock burst, which also sets the Write Protect
+//    5. otherwise the Write Protect is set on its own, if needed
+// In low power mode the pins are released once, at the end.
+// Single writes to the clock registers are left out when
+// the clock burst writes them anyway.
+// Between the sessions there is only the CE inactive time.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302Batch.h"
+
+DS1302Batch::DS1302Batch(DS1302RTC &rtc)
+ : chip(rtc)
+ { clear();
+ }
+
+void DS1302Batch::clear()
+ { count = 0;
+   overflow = false;
+   enableSet = false;
+   clockSet = false;
+   ram = 0;
+   ramLength = 0;
+ }
+
+DS1302Batch &DS1302Batch::write(uint8_t _address, uint8_t _data)
+ { uint8_t i;
+
+   bitClear(_address, DS1302_READBIT);
+
+   if (_address == DS1302_ENABLE)
+    { enableSet = true;
+      enable = _data;
+      return *this;
+    }
+
+   // The last value of a register is the one that counts.
+   for (i = 0; i < count; i++)
+    { if (address[i] == _address)
+       { data[i] = _data;
+         return *this;
+       }
+    }
+
+   if (count < DS1302_BATCH_MAX)
+    { address[count] = _address;
+      data[count] = _data;
+      count++;
+    }
+   else
+      overflow = true;
+
+   return *this;
+ }
+
+DS1302Batch &DS1302Batch::clockBurstWrite(const uint8_t *p)
+ { memcpy(clock, p, 7);
+   clockSet = true;
+   return *this;
+ }
+
+DS1302Batch &DS1302Batch::ramBurstWrite(const uint8_t *p, uint8_t length)
+ { ram = p;
+   ramLength = length > DS1302_RAMSIZE ? DS1302_RAMSIZE : length;
+   return *this;
+ }
+
+// A register that is not written by itself.
+bool DS1302Batch::skip(uint8_t i) const
+ { // The clock burst writes these.
+   if (clockSet && address[i] < DS1302_ENABLE)
+      return true;
+   // Already known
+   return address[i] == DS1302_TRICKLE && chip.trickleKnown &&
+          chip.trickle == data[i];
+ }
+
+bool DS1302Batch::commit()
+ { DS1302_LOCK(chip.mutex);
+   uint8_t i;
+   bool protect, lowPower, write;
+
+   if (overflow)
+    { clear();
+      return false;
+    }
+
+   protect = enableSet ? bitRead(enable, DS1302_WP) : chip.protect;
+   chip.protect = protect;
+
+   // In low power mode, the pins are released after the batch,
+   // not after every session.
+   lowPower = chip.lowPower;
+   chip.lowPower = false;
+
+   // Only clear the Write Protect when something is written.
+   write = clockSet || (ram != 0 && ramLength > 0);
+   for (i = 0; i < count && !write; i++)
+      write = !skip(i);
+   if (write)
+      chip.unprotect();
+
+   for (i = 0; i < count; i++)
+    { if (skip(i))
+         continue;
+      chip.write(address[i], data[i]);
+      if (address[i] < DS1302_ENABLE)
+       { chip.cacheValid = false;
+         chip.driftRef = 0;
+       }
+    }
+
+   if (ram != 0 && ramLength > 0)
+      chip.transfer(DS1302_RAM_BURST_WRITE, (uint8_t *) ram, ramLength);
+
+   if (clockSet)
+    { clock[7] = protect ? bit(DS1302_WP) : 0;
+      chip.clock_burst_write(clock);
+      chip.wp = protect ? DS1302RTC::DS1302_WP_SET : DS1302RTC::DS1302_WP_CLEAR;
+      chip.cacheValid = false;
+      chip.driftRef = 0;       // a new time, the drift anchor is gone
+    }
+   else if (chip.wp != (protect ? DS1302RTC::DS1302_WP_SET : DS1302RTC::DS1302_WP_CLEAR))
+      chip.write(DS1302_ENABLE, protect ? bit(DS1302_WP) : 0);
+
+   chip.lowPower = lowPower;
+   if (lowPower)
+      chip.end();
+
+   clear();
+   return true;
+ }
@@ -0,0 +1,63 @@
+/*
+ * DS1302Batch.h - several register writes as one sequence
+ *
+ * Usage:
+ *    DS1302Batch b(RTC);
+ *    b.write(DS1302_TRICKLE, 0xA5).clockBurstWrite(regs);
+ *    b.commit();
+ *
+ * The DS1302 takes only one command per CE session,
+ * so every write is still a session of its own.
+ * The batch puts them in the cheapest order:
+ * the Write Protect is cleared first and set again last,
+ * preferably as the 8th byte of the clock burst.
+ * A register that is written twice is written once,
+ * and writes that don't change a known value are skipped.
+ */
+
+#ifndef DS1302Batch_h
+#define DS1302Batch_h
+
+#include "DS1302RTC.h"
+
+#ifndef DS1302_BATCH_MAX
+#define DS1302_BATCH_MAX 8       // single writes in a batch
+#endif
+
+class DS1302Batch
+ { public:
+      DS1302Batch(DS1302RTC &rtc);
+
+      // A write of the Enable register sets the Write Protect
+      // after the batch, otherwise it is as setWriteProtect().
+      DS1302Batch &write(uint8_t address, uint8_t data);
+      // 8 bytes, as a clock burst read. The 8th byte is not used.
+      DS1302Batch &clockBurstWrite(const uint8_t *p);
+      // The data must stay valid until commit().
+      DS1302Batch &ramBurstWrite(const uint8_t *p, uint8_t length);
+
+      // Write everything, returns false if the batch was too big.
+      bool commit();
+      void clear();
+
+   private:
+      bool skip(uint8_t i) const;
+
+      DS1302RTC &chip;
+
+      uint8_t address[DS1302_BATCH_MAX];
+      uint8_t data[DS1302_BATCH_MAX];
+      uint8_t count;
+      bool overflow;
+
+      bool enableSet;
+      uint8_t enable;
+
+      bool clockSet;
+      uint8_t clock[8];
+
+      const uint8_t *ram;
+      uint8_t ramLength;
+ };
+
+#endif
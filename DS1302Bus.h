@@ -0,0 +1,38 @@
+/*
+ * DS1302Bus.h - the bit-level interface of the 3-wire bus
+ *
+ * The protocol code in DS1302RTC only uses these primitives,
+ * so the way the pins are driven can be replaced:
+ *    DS1302PinBus   any three Arduino pins (the default)
+ *    DS1302SpiBus   the SPI hardware
+ * On another platform, derive a class from DS1302Bus and
+ * give it to the DS1302RTC(DS1302Bus &) constructor.
+ *
+ * start() raises CE and waits tCC, stop() lowers it and waits tCWH.
+ * togglewrite() shifts a byte out LSB first; with 'release' the
+ * I/O-line is released after the last rising edge, since the
+ * chip starts sending at the falling edge.
+ * toggleread() shifts a byte in, sampled after each falling edge.
+ * end() releases the pins until the next start().
+ */
+
+#ifndef DS1302Bus_h
+#define DS1302Bus_h
+
+#include "DS1302Platform.h"
+#include "DS1302Timing.h"
+
+// transfer() is one complete session, a bus that can move
+// several bytes at once can override it.
+class DS1302Bus
+ { public:
+      virtual void begin(void) { }
+      virtual void end(void) { }
+      virtual void start(void) = 0;
+      virtual void stop(void) = 0;
+      virtual uint8_t toggleread(void) = 0;
+      virtual void togglewrite(uint8_t data, uint8_t release) = 0;
+      virtual void transfer(uint8_t command, uint8_t *p, uint8_t length);
+ };
+
+#endif
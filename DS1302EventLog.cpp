@@ -0,0 +1,216 @@
+// DS1302 event log
+// ----------------
+//
+// The free bytes of the ring are always together, from the
+// write position up to the oldest time stamp, and there is
+// at least one. So the oldest time stamp is the first byte
+// that is not free after the write position.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302EventLog.h"
+
+#define DS1302_LOG_MAGIC  0xA0
+#define DS1302_LOG_MASK   0xE0
+
+// The part of the ram is cut off at the end of the ram.
+// The ring needs at least two bytes, one of them free,
+// with less the log has no ring and can't be used.
+DS1302EventLog::DS1302EventLog(DS1302RAMCache &ram, uint8_t offset, uint8_t length)
+ : cache(ram), header(offset), start(offset + 5), size(0),
+   head(0), base(0), lastTime(0)
+ { if (offset >= DS1302_RAMSIZE)
+      return;
+   if (length > DS1302_RAMSIZE - offset)
+      length = DS1302_RAMSIZE - offset;
+   if (length >= 5 + 2)
+      size = length - 5;
+ }
+
+bool DS1302EventLog::begin()
+ { uint8_t i, pos;
+   uint32_t value;
+
+   if (size == 0)
+      return false;
+
+   head = cache.read(header) & ~DS1302_LOG_MASK;
+   if ((cache.read(header) & DS1302_LOG_MASK) != DS1302_LOG_MAGIC ||
+       head >= size || get(head) != 0)
+    { clear();
+      return false;
+    }
+
+   base = 0;
+   for (i = 0; i < 4; i++)
+      base |= (time_t) cache.read(header + 1 + i) << (8 * i);
+
+   // Add up the differences for the last time stamp.
+   lastTime = base;
+   pos = oldest();
+   while (pos != head)
+    { if (!decode(pos, value))
+       { clear();
+         return false;
+       }
+      lastTime += value - 1;
+    }
+   return true;
+ }
+
+void DS1302EventLog::clear()
+ { uint8_t i;
+
+   if (size == 0)
+      return;                  // not a log, don't touch the ram
+
+   for (i = 0; i < size; i++)
+      put(i, 0x00);
+   setHead(0);
+   setBase(0);
+   lastTime = 0;
+ }
+
+
+// --------------------------------------------------------
+// DS1302EventLog::append
+//
+// A time before the last one can't be stored as a difference,
+// that starts a new log.
+//
+bool DS1302EventLog::append(time_t t)
+ { uint8_t buf[5], n, i, used, pos;
+   uint32_t value;
+
+   if (size == 0)
+      return false;
+
+   if (lastTime == 0 || t < lastTime)
+    { clear();
+      setBase(t);
+      lastTime = t;
+    }
+
+   value = (uint32_t) (t - lastTime) + 1;
+   n = 0;
+   do
+    { buf[n] = value & 0x7F;
+      value >>= 7;
+      if (value != 0)
+         buf[n] |= 0x80;
+      n++;
+    } while (value != 0);
+
+   if (n + 1 > size)
+      return false;
+
+   // Make room, one free byte must be left.
+   for (;;)
+    { used = 0;
+      for (i = 0; i < size; i++)
+         if (get(i) != 0)
+            used++;
+      if (size - used >= n + 1)
+         break;
+      dropOldest();
+    }
+
+   pos = head;
+   for (i = 0; i < n; i++)
+    { put(pos, buf[i]);
+      pos = next(pos);
+    }
+   setHead(pos);
+   lastTime = t;
+
+   return cache.flush();
+ }
+
+
+uint8_t DS1302EventLog::count()
+ { uint8_t n, pos;
+   uint32_t value;
+
+   n = 0;
+   pos = oldest();
+   while (pos != head && decode(pos, value))
+      n++;
+   return n;
+ }
+
+uint8_t DS1302EventLog::read(time_t *t, uint8_t max)
+ { uint8_t n, pos;
+   uint32_t value;
+   time_t time;
+
+   n = 0;
+   time = base;
+   pos = oldest();
+   while (n < max && pos != head && decode(pos, value))
+    { time += value - 1;
+      t[n++] = time;
+    }
+   return n;
+ }
+
+
+// --------------------------------------------------------
+// DS1302EventLog::oldest
+//
+// The position of the oldest time stamp, or the write
+// position if the log is empty.
+//
+uint8_t DS1302EventLog::oldest() const
+ { uint8_t pos;
+
+   pos = next(head);
+   while (pos != head && get(pos) == 0)
+      pos = next(pos);
+   return pos;
+ }
+
+// Read the varint at 'pos', and move 'pos' past it.
+bool DS1302EventLog::decode(uint8_t &pos, uint32_t &value) const
+ { uint8_t b, shift;
+
+   value = 0;
+   shift = 0;
+   do
+    { b = get(pos);
+      if (b == 0 || shift > 28)
+         return false;
+      value |= (uint32_t) (b & 0x7F) << shift;
+      shift += 7;
+      pos = next(pos);
+    } while (b & 0x80);
+   return true;
+ }
+
+void DS1302EventLog::dropOldest()
+ { uint8_t pos, first;
+   uint32_t value;
+
+   first = oldest();
+   pos = first;
+   if (first == head || !decode(pos, value))
+      return;
+
+   setBase(base + value - 1);
+   while (first != pos)
+    { put(first, 0x00);
+      first = next(first);
+    }
+ }
+
+void DS1302EventLog::setBase(time_t t)
+ { uint8_t i;
+
+   base = t;
+   for (i = 0; i < 4; i++)
+      cache.write(header + 1 + i, (uint8_t) ((uint32_t) t >> (8 * i)));
+ }
+
+void DS1302EventLog::setHead(uint8_t pos)
+ { head = pos;
+   cache.write(header, DS1302_LOG_MAGIC | head);
+ }
@@ -0,0 +1,66 @@
+/*
+ * DS1302EventLog.h - a log of time stamps in the DS1302 ram
+ *
+ * Usage:
+ *    DS1302RAMCache ram(RTC);
+ *    DS1302EventLog log(ram);
+ *    ram.load();
+ *    log.begin();
+ *    log.append(RTC.get());
+ *
+ * Layout of the ram (or of a part of it):
+ *    byte 0     : header, 101 and the write position
+ *    bytes 1-4  : base time, LSB first
+ *    the rest   : a ring of time differences
+ * Every time stamp is the difference with the one before it
+ * (the first one with the base), plus one, as a varint:
+ * 7 bits per byte, the high bit set when more bytes follow.
+ * A 0x00 byte is free, a varint never contains one.
+ * When the ring is full, the oldest time stamps are dropped,
+ * and added to the base.
+ * An append changes only a few bytes, which are written
+ * with the flush() of the ram cache.
+ */
+
+#ifndef DS1302EventLog_h
+#define DS1302EventLog_h
+
+#include "DS1302RAMCache.h"
+
+class DS1302EventLog
+ { public:
+      DS1302EventLog(DS1302RAMCache &ram, uint8_t offset = 0,
+                     uint8_t length = DS1302_RAMSIZE);
+
+      // The ram cache must be loaded. A log that is not valid
+      // is cleared, then false is returned. Also false if the
+      // part of the ram is too small for a log (7 bytes).
+      bool begin();
+      void clear();
+      bool append(time_t t);
+
+      uint8_t count();
+      time_t last() const { return lastTime; }
+      // The oldest 'max' time stamps, returns how many.
+      uint8_t read(time_t *t, uint8_t max);
+
+   private:
+      uint8_t next(uint8_t pos) const { return pos + 1 < size ? pos + 1 : 0; }
+      uint8_t get(uint8_t pos) const { return cache.read(start + pos); }
+      void put(uint8_t pos, uint8_t value) { cache.write(start + pos, value); }
+      uint8_t oldest() const;
+      bool decode(uint8_t &pos, uint32_t &value) const;
+      void dropOldest();
+      void setBase(time_t t);
+      void setHead(uint8_t pos);
+
+      DS1302RAMCache &cache;
+      uint8_t header;          // offset of the header byte
+      uint8_t start;           // offset of the ring
+      uint8_t size;            // bytes in the ring
+      uint8_t head;            // write position, always free
+      time_t base;
+      time_t lastTime;
+ };
+
+#endif
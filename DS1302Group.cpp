@@ -0,0 +1,42 @@
+// DS1302 group
+// ------------
+//
+// The chips are read directly after each other, with only
+// the CE inactive time between them. The pins are set up by
+// the first session of every chip and stay that way, so a
+// group read is only the CE changes and the bursts.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302Group.h"
+
+DS1302Group::DS1302Group(DS1302RTC **rtc, uint8_t count)
+ : chips(rtc), n(count)
+ { }
+
+// Read the time of every chip into t[0] .. t[count - 1].
+// Bit i of the result is set when chip i was read, a chip
+// that failed has t[i] 0 and tm[i] not changed.
+uint32_t DS1302Group::read(time_t *t)
+ { uint32_t ok;
+   uint8_t i;
+
+   ok = 0;
+   for (i = 0; i < n; i++)
+    { t[i] = chips[i]->getEpoch();
+      if (t[i] != 0 && i < 32)
+         ok |= 1UL << i;
+    }
+   return ok;
+ }
+
+uint32_t DS1302Group::read(tmElements_t *tm)
+ { uint32_t ok;
+   uint8_t i;
+
+   ok = 0;
+   for (i = 0; i < n; i++)
+      if (chips[i]->read(tm[i]) && i < 32)
+         ok |= 1UL << i;
+   return ok;
+ }
@@ -0,0 +1,30 @@
+/*
+ * DS1302Group.h - read several DS1302 chips back-to-back
+ *
+ * The chips normally share the SCLK and I/O lines,
+ * each with its own CE line:
+ *    DS1302RTC rtc1(5, 6, 7), rtc2(5, 6, 8);
+ *    DS1302RTC *chips[] = { &rtc1, &rtc2 };
+ *    DS1302Group group(chips, 2);
+ */
+
+#ifndef DS1302Group_h
+#define DS1302Group_h
+
+#include "DS1302RTC.h"
+
+class DS1302Group
+ { public:
+      DS1302Group(DS1302RTC **rtc, uint8_t count);
+
+      uint8_t count() const { return n; }
+      // Bit i is set when chip i was read (the first 32 chips).
+      uint32_t read(time_t *t);
+      uint32_t read(tmElements_t *tm);
+
+   private:
+      DS1302RTC **chips;
+      uint8_t n;
+ };
+
+#endif
@@ -0,0 +1,236 @@
+// DS1302 pin bus
+// --------------
+//
+// The 3-wire bus on any three Arduino pins.
+// The timing follows the datasheet, see DS1302Timing.h.
+//
+
+#include <Arduino.h>
+#include "DS1302PinBus.h"
+
+
+// Pin access.
+// With DS1302RTC_FASTIO the port registers are used directly.
+// Like digitalWrite(), the read-modify-write of a port register
+// is done with interrupts disabled, since an interrupt routine
+// could change other bits of the same port.
+#ifdef DS1302RTC_FASTIO
+static inline void fastWrite(volatile uint8_t *reg, uint8_t mask, uint8_t value)
+ { uint8_t oldSREG = SREG;
+   cli();
+   if (value)
+      *reg |= mask;
+   else
+      *reg &= ~mask;
+   SREG = oldSREG;
+ }
+
+#define DS1302_IO_WRITE(v)     fastWrite(ioPort, ioMask, (v))
+#define DS1302_IO_READ()       ((*ioPin & ioMask) ? HIGH : LOW)
+#define DS1302_IO_OUTPUT()     fastWrite(ioDdr, ioMask, 1)
+#define DS1302_IO_INPUT()      do { fastWrite(ioDdr, ioMask, 0); \
+                                    fastWrite(ioPort, ioMask, 0); } while (0)
+#define DS1302_SCLK_WRITE(v)   fastWrite(sclkPort, sclkMask, (v))
+#define DS1302_SCLK_OUTPUT()   fastWrite(sclkDdr, sclkMask, 1)
+#define DS1302_SCLK_INPUT()    fastWrite(sclkDdr, sclkMask, 0)
+#define DS1302_RST_WRITE(v)    fastWrite(rstPort, rstMask, (v))
+#define DS1302_RST_OUTPUT()    fastWrite(rstDdr, rstMask, 1)
+#else
+#define DS1302_IO_WRITE(v)     digitalWrite(io, (v))
+#define DS1302_IO_READ()       digitalRead(io)
+#define DS1302_IO_OUTPUT()     pinMode(io, OUTPUT)
+#define DS1302_IO_INPUT()      pinMode(io, INPUT)
+#define DS1302_SCLK_WRITE(v)   digitalWrite(sclk, (v))
+#define DS1302_SCLK_OUTPUT()   pinMode(sclk, OUTPUT)
+#define DS1302_SCLK_INPUT()    pinMode(sclk, INPUT)
+#define DS1302_RST_WRITE(v)    digitalWrite(rst, (v))
+#define DS1302_RST_OUTPUT()    pinMode(rst, OUTPUT)
+#endif
+
+
+uint8_t DS1302PinBus::ioOutput = 0xFF;
+uint8_t DS1302PinBus::sclkOutput = 0xFF;
+
+
+// --------------------------------------------------------
+// DS1302PinBus::setPins
+//
+// Select the three pins of the bus.
+//
+void DS1302PinBus::setPins(uint8_t _io, uint8_t _sclk, uint8_t _rst)
+ { io = _io;
+   sclk = _sclk;
+   rst = _rst;
+   configured = false;
+
+#ifdef DS1302RTC_FASTIO
+   // Resolve the pins to port registers once,
+   // so the bit-bang loops don't need the pin tables.
+   ioPort = portOutputRegister(digitalPinToPort(io));
+   ioPin = portInputRegister(digitalPinToPort(io));
+   ioDdr = portModeRegister(digitalPinToPort(io));
+   ioMask = digitalPinToBitMask(io);
+   sclkPort = portOutputRegister(digitalPinToPort(sclk));
+   sclkDdr = portModeRegister(digitalPinToPort(sclk));
+   sclkMask = digitalPinToBitMask(sclk);
+   rstPort = portOutputRegister(digitalPinToPort(rst));
+   rstDdr = portModeRegister(digitalPinToPort(rst));
+   rstMask = digitalPinToBitMask(rst);
+#endif
+ }
+
+
+// --------------------------------------------------------
+// DS1302PinBus::begin
+//
+// Set up the pins, once.
+// The CE and SCLK pins stay outputs, and are low between sessions.
+// That also holds when several chips share the SCLK
+// and I/O-line, each with its own CE.
+// At startup, the pins of the Arduino are high impedance.
+// Since the DS1302 has pull-down resistors,
+// the signals are low (inactive) until the DS1302 is used.
+//
+void DS1302PinBus::begin(void)
+ { DS1302_RST_WRITE(LOW);  // default, not enabled
+   DS1302_RST_OUTPUT();
+
+   DS1302_SCLK_WRITE(LOW);  // default, clock low
+   DS1302_SCLK_OUTPUT();
+   sclkOutput = sclk;
+
+   DS1302_IO_OUTPUT();
+   ioOutput = io;
+
+   configured = true;
+ }
+
+
+// --------------------------------------------------------
+// DS1302PinBus::end
+//
+// Make SCLK and the I/O-line high impedance,
+// the pull-down resistors of the DS1302 keep them low.
+// CE stays an output and low, so the chip stays disabled.
+// The next session sets the pins up again, also for the
+// other objects on the same SCLK.
+//
+void DS1302PinBus::end(void)
+ { DS1302_SCLK_INPUT();
+   DS1302_IO_INPUT();
+   if (sclkOutput == sclk)
+      sclkOutput = 0xFF;
+   if (ioOutput == io)
+      ioOutput = 0xFF;
+
+   configured = false;
+ }
+
+
+// --------------------------------------------------------
+// DS1302PinBus::start
+//
+// A helper function to setup the start condition.
+//
+// Only CE is raised. The pins are set up by begin(),
+// which is called here if the sketch didn't, or if another
+// object on the same SCLK released it with end().
+// The direction of the I/O-line is set by togglewrite().
+void DS1302PinBus::start(void)
+ { if (!configured || sclkOutput != sclk)
+      begin();
+
+   DS1302_RST_WRITE(HIGH);  // start the session
+   DS1302_DELAY_TCC();       // tCC
+ }
+
+
+// --------------------------------------------------------
+// DS1302PinBus::stop
+//
+// A helper function to finish the communication.
+//
+void DS1302PinBus::stop(void)
+ { // Set CE low
+   DS1302_RST_WRITE(LOW);
+   DS1302_DELAY_TCWH();      // tCWH
+ }
+
+
+// --------------------------------------------------------
+// DS1302PinBus::toggleread
+//
+// A helper function for reading a byte with bit toggle
+//
+// This function assumes that the SCLK is still high.
+//
+uint8_t DS1302PinBus::toggleread(void)
+ { uint8_t i, data;
+
+   data = 0;
+   for (i = 0; i <= 7; i++)
+    { // Issue a clock pulse for the next databit.
+      // If the 'togglewrite' function was used before
+      // this function, the SCLK is already high.
+      DS1302_SCLK_WRITE(HIGH);
+      DS1302_DELAY_TCH();
+
+      // Clock down, data is ready after some time.
+      DS1302_SCLK_WRITE(LOW);
+      DS1302_DELAY_TCL();         // tCL, tCDD
+
+      // read bit, and set it in place in 'data' variable
+      bitWrite(data, i, DS1302_IO_READ());
+    }
+   return (data);
+ }
+
+
+// --------------------------------------------------------
+// DS1302PinBus::togglewrite
+//
+// A helper function for writing a byte with bit toggle
+//
+// The 'release' parameter is for a read after this write.
+// It will release the I/O-line and will keep the SCLK high.
+//
+void DS1302PinBus::togglewrite(uint8_t data, uint8_t release)
+ { int i;
+
+   // The I/O-line is an input after a read.
+   if (ioOutput != io)
+    { DS1302_IO_OUTPUT();
+      ioOutput = io;
+    }
+
+   for (i = 0; i <= 7; i++)
+    { // set a bit of the data on the I/O-line
+      DS1302_IO_WRITE(bitRead(data, i));
+      DS1302_DELAY_TDC();      // tDC
+
+      // clock up, data is read by DS1302
+      DS1302_SCLK_WRITE(HIGH);
+      DS1302_DELAY_TCH();      // tCH, tCDH
+
+      if (release && i == 7)
+       { // If this write is followed by a read,
+         // the I/O-line should be released after
+         // the last bit, before the clock line is made low.
+         // This is according the datasheet.
+         // I have seen other programs that don't release
+         // the I/O-line at this moment,
+         // and that could cause a shortcut spike
+         // on the I/O-line.
+         DS1302_IO_INPUT();
+         ioOutput = 0xFF;
+
+         // For Arduino 1.0.3, removing the pull-up is no longer needed.
+         // Setting the pin as 'INPUT' will already remove the pull-up.
+         // digitalWrite (DS1302_IO, LOW); // remove any pull-up
+       }
+      else
+       { DS1302_SCLK_WRITE(LOW);
+         DS1302_DELAY_TCL();        // tCL, tCDD
+       }
+    }
+ }
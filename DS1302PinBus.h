@@ -0,0 +1,56 @@
+/*
+ * DS1302PinBus.h - the 3-wire bus on three Arduino pins
+ */
+
+#ifndef DS1302PinBus_h
+#define DS1302PinBus_h
+
+#include <Arduino.h>
+#include "DS1302Bus.h"
+
+// On AVR the pins are accessed through their port registers,
+// which is a lot faster than digitalWrite() and digitalRead().
+// Define DS1302RTC_NO_FASTIO to use the Arduino pin functions.
+#if defined(__AVR__) && !defined(DS1302RTC_NO_FASTIO)
+#define DS1302RTC_FASTIO
+#endif
+
+// The bus on any three Arduino pins, selected at runtime.
+class DS1302PinBus : public DS1302Bus
+ { public:
+      void setPins(uint8_t io, uint8_t sclk, uint8_t rst);
+
+      void begin(void);
+      void end(void);
+      void start(void);
+      void stop(void);
+      uint8_t toggleread(void);
+      void togglewrite(uint8_t data, uint8_t release);
+
+   private:
+      uint8_t io;
+      uint8_t sclk;
+      uint8_t rst;
+      bool configured;        // the pins are set up
+
+      // The I/O and SCLK pins that are outputs, or 0xFF.
+      // Shared by all objects, since they can share the lines.
+      static uint8_t ioOutput;
+      static uint8_t sclkOutput;
+
+#ifdef DS1302RTC_FASTIO
+      // Port registers and bitmasks, resolved once by setPins().
+      volatile uint8_t *ioPort;
+      volatile uint8_t *ioPin;
+      volatile uint8_t *ioDdr;
+      uint8_t ioMask;
+      volatile uint8_t *sclkPort;
+      volatile uint8_t *sclkDdr;
+      uint8_t sclkMask;
+      volatile uint8_t *rstPort;
+      volatile uint8_t *rstDdr;
+      uint8_t rstMask;
+#endif
+ };
+
+#endif
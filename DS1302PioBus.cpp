@@ -0,0 +1,236 @@
+// DS1302 PIO bus
+// --------------
+//
+// The PIO program, side-set is SCLK,
+// the OUT, SET and IN pin is the I/O-line:
+//
+//    .program ds1302
+//    .side_set 1 opt
+//    entry:
+//        pull block          side 0
+//        out y, 1                    ; write flag
+//        jmp !y rdonly
+//        set pindirs, 1
+//        set y, 7
+//    wbit:
+//        out pins, 1         side 0 [3]
+//        jmp y-- wbit        side 1 [3]
+//        out x, 8                    ; bits to read
+//        jmp !x entry
+//        set pindirs, 0              ; release, SCLK is high
+//        jmp x-- rbit
+//    rbit:
+//        nop                 side 0 [3]
+//        in pins, 1
+//        jmp x-- rhigh
+//        jmp entry
+//    rhigh:
+//        jmp rbit            side 1 [3]
+//    rdonly:
+//        out null, 8
+//        out x, 8
+//        jmp x-- rhigh
+//
+// Every word of the TX FIFO is one operation:
+//    bit 0      : 1 = write the byte
+//    bits 8-1   : the byte
+//    bits 16-9  : number of bits to read after it
+// A read-only operation continues a read, with SCLK low.
+// The bits are autopushed per byte, shifted to bits 31-24.
+//
+// One PIO cycle is a quarter of the longest clock phase, rounded
+// up, so a phase is four cycles and never shorter than the datasheet.
+//
+
+#include "DS1302PioBus.h"
+
+#ifdef DS1302RTC_PIO
+
+#include <hardware/clocks.h>
+
+// CE is a normal GPIO. Without the Arduino core (a plain
+// Pico SDK build) it is driven with the SDK functions.
+#ifdef ARDUINO
+#define DS1302_CE_WRITE(v)     digitalWrite(cePin, (v) ? HIGH : LOW)
+#define DS1302_CE_OUTPUT()     pinMode(cePin, OUTPUT)
+#else
+#include <hardware/gpio.h>
+#define DS1302_CE_WRITE(v)     gpio_put(cePin, (v))
+#define DS1302_CE_OUTPUT()     do { gpio_init(cePin); \
+                                    gpio_set_dir(cePin, GPIO_OUT); } while (0)
+#endif
+
+static const uint16_t ds1302_program_instructions[] =
+ { 0x90A0,   //  0: pull   block           side 0
+   0x6041,   //  1: out    y, 1
+   0x0070,   //  2: jmp    !y, 16
+   0xE081,   //  3: set    pindirs, 1
+   0xE047,   //  4: set    y, 7
+   0x7301,   //  5: out    pins, 1         side 0 [3]
+   0x1B85,   //  6: jmp    y--, 5          side 1 [3]
+   0x6028,   //  7: out    x, 8
+   0x0020,   //  8: jmp    !x, 0
+   0xE080,   //  9: set    pindirs, 0
+   0x004B,   // 10: jmp    x--, 11
+   0xB342,   // 11: nop                    side 0 [3]
+   0x4001,   // 12: in     pins, 1
+   0x004F,   // 13: jmp    x--, 15
+   0x0000,   // 14: jmp    0
+   0x1B0B,   // 15: jmp    11              side 1 [3]
+   0x6068,   // 16: out    null, 8
+   0x6028,   // 17: out    x, 8
+   0x004F    // 18: jmp    x--, 15
+ };
+
+static const struct pio_program ds1302_program =
+ { ds1302_program_instructions,
+   sizeof(ds1302_program_instructions) / sizeof(ds1302_program_instructions[0]),
+   -1
+ };
+
+#define DS1302_PIO_WRITE      0x0001
+#define DS1302_PIO_DATA(b)    ((uint32_t) (b) << 1)
+#define DS1302_PIO_READ(n)    ((uint32_t) (n) << 9)
+
+#define DS1302_PIO_CYCLE_NS \
+   ((DS1302_MAX_NS(DS1302_MAX_NS(DS1302_TCH_NS, DS1302_TCDH_NS), \
+                  DS1302_MAX_NS(DS1302_TCL_NS, DS1302_TCDD_NS)) + 3) / 4)
+
+
+DS1302PioBus::DS1302PioBus(PIO _pio, uint8_t io, uint8_t sclk, uint8_t ce)
+ : pio(_pio), sm(-1), offset(0), ioPin(io), sclkPin(sclk), cePin(ce),
+   configured(false), reading(false)
+ { }
+
+
+// --------------------------------------------------------
+// DS1302PioBus::begin
+//
+// Load the program and start the state machine.
+//
+void DS1302PioBus::begin(void)
+ { pio_sm_config c;
+   uint32_t div;
+
+   DS1302_CE_WRITE(0);         // not enabled
+   DS1302_CE_OUTPUT();
+
+   if (sm < 0)
+    { sm = pio_claim_unused_sm(pio, true);
+      offset = pio_add_program(pio, &ds1302_program);
+    }
+
+   pio_gpio_init(pio, ioPin);
+   pio_gpio_init(pio, sclkPin);
+   pio_sm_set_pins_with_mask(pio, sm, 0, (1u << sclkPin) | (1u << ioPin));
+   pio_sm_set_pindirs_with_mask(pio, sm, (1u << sclkPin) | (1u << ioPin),
+                                (1u << sclkPin) | (1u << ioPin));
+
+   c = pio_get_default_sm_config();
+   sm_config_set_wrap(&c, offset, offset + ds1302_program.length - 1);
+   sm_config_set_sideset(&c, 2, true, false);
+   sm_config_set_sideset_pins(&c, sclkPin);
+   sm_config_set_out_pins(&c, ioPin, 1);
+   sm_config_set_set_pins(&c, ioPin, 1);
+   sm_config_set_in_pins(&c, ioPin);
+   sm_config_set_out_shift(&c, true, false, 32);
+   sm_config_set_in_shift(&c, true, true, 8);
+
+   // in 1/256, rounded up so no phase is shorter than the datasheet
+   div = (uint32_t) (((uint64_t) clock_get_hz(clk_sys) * DS1302_PIO_CYCLE_NS
+                      * 256 + 999999999) / 1000000000);
+   if (div < 256)
+      div = 256;
+   sm_config_set_clkdiv_int_frac(&c, div >> 8, div & 0xFF);
+
+   pio_sm_init(pio, sm, offset, &c);
+   pio_sm_set_enabled(pio, sm, true);
+
+   configured = true;
+ }
+
+
+void DS1302PioBus::start(void)
+ { if (!configured)
+      begin();
+
+   reading = false;
+   DS1302_CE_WRITE(1);
+   DS1302_DELAY_TCC();         // tCC
+ }
+
+
+void DS1302PioBus::stop(void)
+ { DS1302_CE_WRITE(0);
+   DS1302_DELAY_TCWH();        // tCWH
+ }
+
+
+// --------------------------------------------------------
+// DS1302PioBus::put, wait
+//
+// Give an operation to the state machine,
+// and wait until it has done all of them.
+// It is done when it stalls on an empty TX FIFO.
+// The stall flag is cleared after the put, while the state
+// machine is busy with at least a byte (8 clock periods).
+//
+void DS1302PioBus::put(uint32_t op)
+ { pio_sm_put_blocking(pio, sm, op);
+   pio->fdebug = 1u << (PIO_FDEBUG_TXSTALL_LSB + sm);
+ }
+
+void DS1302PioBus::wait(void)
+ { while (!(pio->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + sm))))
+      ;
+ }
+
+
+uint8_t DS1302PioBus::toggleread(void)
+ { // The first byte after the command is already on its way.
+   if (!reading)
+      put(DS1302_PIO_READ(8));
+   reading = false;
+   return (uint8_t) (pio_sm_get_blocking(pio, sm) >> 24);
+ }
+
+
+void DS1302PioBus::togglewrite(uint8_t data, uint8_t release)
+ { if (release)
+    { // The state machine reads the first byte right away.
+      put(DS1302_PIO_WRITE | DS1302_PIO_DATA(data) | DS1302_PIO_READ(8));
+      reading = true;
+    }
+   else
+    { put(DS1302_PIO_WRITE | DS1302_PIO_DATA(data));
+      wait();
+    }
+ }
+
+
+// --------------------------------------------------------
+// DS1302PioBus::transfer
+//
+// A whole read is one operation, the CPU only
+// takes the bytes from the RX FIFO.
+//
+void DS1302PioBus::transfer(uint8_t command, uint8_t *p, uint8_t length)
+ { uint8_t i;
+
+   start();
+   if (bitRead(command, DS1302_READBIT))
+    { put(DS1302_PIO_WRITE | DS1302_PIO_DATA(command) |
+          DS1302_PIO_READ(8 * length));
+      for (i = 0; i < length; i++)
+         p[i] = (uint8_t) (pio_sm_get_blocking(pio, sm) >> 24);
+    }
+   else
+    { put(DS1302_PIO_WRITE | DS1302_PIO_DATA(command));
+      for (i = 0; i < length; i++)
+         put(DS1302_PIO_WRITE | DS1302_PIO_DATA(p[i]));
+      wait();
+    }
+   stop();
+ }
+
+#endif
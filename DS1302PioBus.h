@@ -0,0 +1,53 @@
+/*
+ * DS1302PioBus.h - the 3-wire bus on a PIO state machine (RP2040)
+ *
+ * Usage:
+ *    DS1302PioBus pioBus(pio0, 5, 6, 7);   // pio, io, sclk, ce
+ *    DS1302RTC RTC(pioBus);
+ *
+ * The state machine shifts the command byte, releases the
+ * I/O-line after the 8th rising edge, and clocks in the data;
+ * the bytes are read from the RX FIFO.
+ * CE is a normal GPIO, driven by start() and stop().
+ * The bit timing is done by the PIO clock divider,
+ * with the values of DS1302Timing.h.
+ */
+
+#ifndef DS1302PioBus_h
+#define DS1302PioBus_h
+
+#include "DS1302RTC.h"
+
+#if defined(ARDUINO_ARCH_RP2040) || defined(PICO_BOARD)
+#define DS1302RTC_PIO
+
+#include <hardware/pio.h>
+
+class DS1302PioBus : public DS1302Bus
+ { public:
+      DS1302PioBus(PIO pio, uint8_t io, uint8_t sclk, uint8_t ce);
+
+      void begin(void);
+      void start(void);
+      void stop(void);
+      uint8_t toggleread(void);
+      void togglewrite(uint8_t data, uint8_t release);
+      void transfer(uint8_t command, uint8_t *p, uint8_t length);
+
+   private:
+      void put(uint32_t op);
+      void wait(void);
+
+      PIO pio;
+      int sm;
+      uint offset;
+      uint8_t ioPin;
+      uint8_t sclkPin;
+      uint8_t cePin;
+      bool configured;
+      bool reading;           // the I/O-line is released
+ };
+
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * DS1302Platform.h - what the library needs from the platform
+ *
+ * On Arduino that is Arduino.h.
+ * Elsewhere (a Linux board, the Pico SDK) the protocol code
+ * only needs these helpers, and the platform must provide:
+ *    uint32_t millis(void);
+ *    uint32_t micros(void);
+ *    void delayMicroseconds(unsigned int us);
+ *    void noInterrupts(void);    // may be empty without interrupts
+ *    void interrupts(void);
+ * The bus itself is a DS1302Bus of that platform.
+ */
+
+#ifndef DS1302Platform_h
+#define DS1302Platform_h
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>
+#include <string.h>
+
+#ifndef HIGH
+#define HIGH 1
+#define LOW  0
+#endif
+
+#ifndef bit
+#define bit(b)                ((uint8_t) (1U << (b)))
+#define bitRead(value, b)     (((value) >> (b)) & 0x01)
+#define bitSet(value, b)      ((value) |= bit(b))
+#define bitClear(value, b)    ((value) &= ~bit(b))
+#endif
+
+#ifndef PROGMEM
+#define PROGMEM
+#define pgm_read_byte(p)      (*(const uint8_t *) (p))
+#define pgm_read_word(p)      (*(const uint16_t *) (p))
+#endif
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delayMicroseconds(unsigned int us);
+void noInterrupts(void);
+void interrupts(void);
+#endif
+
+// Memory barrier for the snapshot of DS1302RTC_THREADSAFE.
+#if defined(__AVR__)
+#define DS1302_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+#else
+#define DS1302_BARRIER()  __sync_synchronize()
+#endif
+
+// With DS1302RTC_THREADSAFE, the bus of a chip is used by one
+// task at a time, with a recursive FreeRTOS mutex.
+#ifdef DS1302RTC_THREADSAFE
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <FreeRTOS.h>
+#include <semphr.h>
+#endif
+
+class DS1302Mutex
+ { public:
+      // Once, a static object is zero before the constructors.
+      void init()
+       { if (handle == 0)
+            handle = xSemaphoreCreateRecursiveMutex();
+       }
+      void lock() { xSemaphoreTakeRecursive(handle, portMAX_DELAY); }
+      void unlock() { xSemaphoreGiveRecursive(handle); }
+
+   private:
+      SemaphoreHandle_t handle;
+ };
+
+// Holds the mutex until the end of the block.
+class DS1302Lock
+ { public:
+      DS1302Lock(DS1302Mutex &m) : mutex(m) { mutex.lock(); }
+      ~DS1302Lock() { mutex.unlock(); }
+
+   private:
+      DS1302Mutex &mutex;
+ };
+
+#define DS1302_LOCK(m)  DS1302Lock lock(m)
+#else
+#define DS1302_LOCK(m)
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+// DS1302 ram cache
+// ----------------
+//
+// A write only marks the byte as dirty if its value changes.
+// flush() then chooses between one burst from the first byte
+// up to the last dirty byte, or a write for every dirty run.
+// The burst also writes the clean bytes before the last dirty
+// byte, but those are written with the same value.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302RAMCache.h"
+
+DS1302RAMCache::DS1302RAMCache(DS1302RTC &_rtc)
+ : rtc(_rtc)
+ { memset(ram, 0, sizeof(ram));
+   dirtyMask = 0;
+ }
+
+bool DS1302RAMCache::load()
+ { if (!rtc.readRAM(ram, 0, DS1302_RAMSIZE))
+      return false;
+
+   dirtyMask = 0;
+   return true;
+ }
+
+bool DS1302RAMCache::read(uint8_t *p, uint8_t offset, uint8_t length) const
+ { if (offset + length > DS1302_RAMSIZE)
+      return false;
+
+   memcpy(p, ram + offset, length);
+   return true;
+ }
+
+void DS1302RAMCache::write(uint8_t offset, uint8_t value)
+ { if (offset >= DS1302_RAMSIZE || ram[offset] == value)
+      return;
+
+   ram[offset] = value;
+   dirtyMask |= 1UL << offset;
+ }
+
+bool DS1302RAMCache::write(const uint8_t *p, uint8_t offset, uint8_t length)
+ { uint8_t i;
+
+   if (offset + length > DS1302_RAMSIZE)
+      return false;
+
+   for (i = 0; i < length; i++)
+      write(offset + i, p[i]);
+   return true;
+ }
+
+bool DS1302RAMCache::flush()
+ { uint8_t i, first, count, last;
+
+   if (dirtyMask == 0)
+      return true;
+
+   // Count the dirty bytes and find the last one.
+   count = 0;
+   last = 0;
+   for (i = 0; i < DS1302_RAMSIZE; i++)
+    { if (dirtyMask & (1UL << i))
+       { count++;
+         last = i;
+       }
+    }
+
+   if (DS1302_COST_NS(2 + last, 1) <= DS1302_COST_NS(2 * count, count))
+    { if (!rtc.writeRAM(ram, 0, last + 1))
+         return false;
+    }
+   else
+    { // Write every run of dirty bytes.
+      for (i = 0; i <= last; i++)
+       { if (!(dirtyMask & (1UL << i)))
+            continue;
+         first = i;
+         while (i < last && (dirtyMask & (1UL << (i + 1))))
+            i++;
+         if (!rtc.writeRAM(ram + first, first, i - first + 1))
+            return false;
+       }
+    }
+
+   dirtyMask = 0;
+   return true;
+ }
@@ -0,0 +1,36 @@
+/*
+ * DS1302RAMCache.h - shadow copy of the DS1302 ram
+ *
+ * The 31 bytes of ram are loaded once with a burst read.
+ * Reads and writes only use the shadow copy,
+ * flush() writes the changed bytes back to the chip.
+ */
+
+#ifndef DS1302RAMCache_h
+#define DS1302RAMCache_h
+
+#include "DS1302RTC.h"
+
+class DS1302RAMCache
+ { public:
+      DS1302RAMCache(DS1302RTC &rtc);
+
+      bool load();
+      bool flush();
+      bool dirty() const { return dirtyMask != 0; }
+
+      // Out of range, read() is 0, write() is ignored and the
+      // burst read and write return false.
+      uint8_t read(uint8_t offset) const
+       { return offset < DS1302_RAMSIZE ? ram[offset] : 0; }
+      bool read(uint8_t *p, uint8_t offset, uint8_t length) const;
+      void write(uint8_t offset, uint8_t value);
+      bool write(const uint8_t *p, uint8_t offset, uint8_t length);
+
+   private:
+      DS1302RTC &rtc;
+      uint8_t ram[DS1302_RAMSIZE];
+      uint32_t dirtyMask;     // one bit for every byte
+ };
+
+#endif
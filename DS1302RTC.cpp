@@ -27,6 +27,8 @@
 // Even the shiftOut() function is not used, since it
 // could be too fast (it might be slow enough,
 // but that's not certain).
+// With a resistor between MOSI and MISO, the SPI hardware
+// can be used after all, see DS1302SpiBus.h
 //
 // I wrote my own interface code according to the datasheet.
 // Any three pins of the Arduino can be used.
@@ -78,8 +80,8 @@
 // The contents will be lost if the Arduino is off,
 // and the backup battery gets empty.
 // It is better to store data in the EEPROM of the Arduino.
-// The burst read or burst write for ram is not implemented
-// in this code.
+// readRAM() and writeRAM() use the ram burst commands when
+// that takes less bus time than single byte accesses.
 //
 //
 // Trickle charge
@@ -87,11 +89,11 @@
 // The DS1302 has a build-in trickle charger.
 // That can be used for example with a lithium battery
 // or a supercap.
-// Using the trickle charger has not been implemented
-// in this code.
+// It is set with setTrickleCharger(), the time functions
+// leave it as it is.
 //
 
-#include <Arduino.h>
+#include "DS1302Platform.h"
 #include "DS1302RTC.h"
 
 // Macros to convert the bcd values of the registers to normal
@@ -101,74 +103,9 @@
 #define bcd2bin(h,l)    (((h)*10) + (l))
 #define bin2bcd_h(x)   ((x)/10)
 #define bin2bcd_l(x)    ((x)%10)
+#define bin2bcd(x)      ((bin2bcd_h(x) << 4) | bin2bcd_l(x))
 
 
-// Register names.
-// Since the highest bit is always '1',
-// the registers start at 0x80
-// If the register is read, the lowest bit should be '1'.
-#define DS1302_SECONDS           0x80
-#define DS1302_MINUTES           0x82
-#define DS1302_HOURS             0x84
-#define DS1302_DATE              0x86
-#define DS1302_MONTH             0x88
-#define DS1302_DAY               0x8A
-#define DS1302_YEAR              0x8C
-#define DS1302_ENABLE            0x8E
-#define DS1302_TRICKLE           0x90
-#define DS1302_CLOCK_BURST       0xBE
-#define DS1302_CLOCK_BURST_WRITE 0xBE
-#define DS1302_CLOCK_BURST_READ  0xBF
-#define DS1302_RAMSTART          0xC0
-#define DS1302_RAMEND            0xFC
-#define DS1302_RAM_BURST         0xFE
-#define DS1302_RAM_BURST_WRITE   0xFE
-#define DS1302_RAM_BURST_READ    0xFF
-
-
-// Defines for the bits, to be able to change
-// between bit number and binary definition.
-// By using the bit number, using the DS1302
-// is like programming an AVR microcontroller.
-// But instead of using "(1<<X)", or "_BV(X)",
-// the Arduino "bit(X)" is used.
-#define DS1302_D0 0
-#define DS1302_D1 1
-#define DS1302_D2 2
-#define DS1302_D3 3
-#define DS1302_D4 4
-#define DS1302_D5 5
-#define DS1302_D6 6
-#define DS1302_D7 7
-
-
-// Bit for reading (bit in address)
-#define DS1302_READBIT DS1302_D0 // READBIT=1: read instruction
-
-// Bit for clock (0) or ram (1) area,
-// called R/C-bit (bit in address)
-#define DS1302_RC DS1302_D6
-
-// Seconds Register
-#define DS1302_CH DS1302_D7   // 1 = Clock Halt, 0 = start
-
-// Hour Register
-#define DS1302_AM_PM DS1302_D5 // 0 = AM, 1 = PM
-#define DS1302_12_24 DS1302_D7 // 0 = 24 hour, 1 = 12 hour
-
-// Enable Register
-#define DS1302_WP DS1302_D7   // 1 = Write Protect, 0 = enabled
-
-// Trickle Register
-#define DS1302_ROUT0 DS1302_D0
-#define DS1302_ROUT1 DS1302_D1
-#define DS1302_DS0   DS1302_D2
-#define DS1302_DS1   DS1302_D2
-#define DS1302_TCS0  DS1302_D4
-#define DS1302_TCS1  DS1302_D5
-#define DS1302_TCS2  DS1302_D6
-#define DS1302_TCS3  DS1302_D7
-
 // Structure for the first 8 registers.
 // These 8 bytes can be read at once with
 // the 'clock burst' command.
@@ -210,96 +147,1016 @@ typedef struct
    uint8_t WP: 1;            // WP = Write Protect
  } ds1302_struct;
 
+
+// Tables for decoding the registers.
+// The tens digit of a bcd byte, indexed by the high nibble.
+static const uint8_t bcdTens[16] PROGMEM =
+ { 0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150 };
+
+// The hour modulo 12 of the 12 hour format,
+// indexed by the digits (the lower 5 bits of the register).
+static const uint8_t hours12[32] PROGMEM =
+ { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0,
+  10, 11, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+#define bcd2bin_byte(b)  (pgm_read_byte(&bcdTens[(b) >> 4]) + ((b) & 0x0F))
+
+
+// Convert the clock registers, as read with a clock burst,
+// to the Time library format.
+// The register bytes are used directly instead of the
+// ds1302_struct bitfields, which compile to long sequences
+// of shifts and masks.
+// Both hour formats are decoded, and the one of the
+// 12/24 bit is selected with a mask instead of a branch.
+static inline uint8_t decodeHour(uint8_t h)
+ { uint8_t h12, h24, mode;
+
+   mode = bitRead(h, DS1302_12_24);             // 1 = 12 hour
+   h24 = bcd2bin_byte(h & 0x3F);
+   h12 = pgm_read_byte(&hours12[h & 0x1F]) + 12 * bitRead(h, DS1302_AM_PM);
+   return h24 ^ ((h24 ^ h12) & (uint8_t) -mode);
+ }
+
+void DS1302RTC::decode(const uint8_t *p, tmElements_t &tm)
+ { tm.Second = bcd2bin_byte(p[0] & 0x7F);      // without CH
+   tm.Minute = bcd2bin_byte(p[1] & 0x7F);
+   tm.Hour = decodeHour(p[2]);
+   tm.Day = bcd2bin_byte(p[3] & 0x3F);
+   tm.Month = bcd2bin_byte(p[4] & 0x1F);
+   tm.Wday = p[5] & 0x07;
+   tm.Year = bcd2bin_byte(p[6]) + (2000 - 1970);
+ }
+
+
+// Check the clock registers of a burst read.
+// A floating I/O-line reads as all zeros or all ones,
+// neither is a valid date (day 0, or digits above 9).
+#define bcdValid(b)  (((b) & 0x0F) <= 9 && ((b) & 0xF0) <= 0x90)
+
+bool DS1302RTC::valid(const uint8_t *p)
+ { uint8_t h;
+
+   if (!bcdValid(p[0] & 0x7F) || (p[0] & 0x7F) > 0x59)
+      return false;
+   if (!bcdValid(p[1]) || p[1] > 0x59)
+      return false;
+
+   if (bitRead(p[2], DS1302_12_24))
+    { h = p[2] & 0x1F;
+      if (bitRead(p[2], DS1302_D6) || !bcdValid(h) || h < 0x01 || h > 0x12)
+         return false;
+    }
+   else if (!bcdValid(p[2]) || p[2] > 0x23)
+      return false;
+
+   if (!bcdValid(p[3]) || p[3] < 0x01 || p[3] > 0x31)
+      return false;
+   if (!bcdValid(p[4]) || p[4] < 0x01 || p[4] > 0x12)
+      return false;
+   if (p[5] < 1 || p[5] > 7)
+      return false;
+   if (!bcdValid(p[6]))
+      return false;
+
+   // Only the WP bit can be set in the Enable register.
+   return (p[7] & 0x7F) == 0;
+ }
+
+
+// Days before the first day of the month, in a non-leap year.
+static const uint16_t monthDays[12] PROGMEM =
+ { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+// 2000-01-01 00:00:00, the first time of the DS1302.
+#define DS1302_EPOCH_2000  946684800UL
+
+// Convert the clock registers straight to a time_t.
+// The DS1302 covers 2000-2099, in which every fourth year
+// is a leap year, so the days follow from the year without
+// the loops of makeTime().
+time_t DS1302RTC::epoch(const uint8_t *p)
+ { uint8_t year, month;
+   uint16_t days;
+
+   year = bcd2bin_byte(p[6]);
+   month = bcd2bin_byte(p[4] & 0x1F);
+   if (month < 1 || month > 12)
+      return 0;
+
+   days = year * 365U + (year + 3) / 4 +
+          pgm_read_word(&monthDays[month - 1]) +
+          bcd2bin_byte(p[3] & 0x3F) - 1;
+   if ((year & 3) == 0 && month > 2)
+      days++;
+
+   return DS1302_EPOCH_2000 + days * SECS_PER_DAY +
+          decodeHour(p[2]) * 3600UL +
+          bcd2bin_byte(p[1] & 0x7F) * 60U +
+          bcd2bin_byte(p[0] & 0x7F);
+ }
+
+// Convert a time_t straight to the clock registers.
+// Returns false if the time is outside 2000-2099.
+static bool encodeEpoch(time_t t, uint8_t *p)
+ { uint32_t secs;
+   uint16_t days, leap;
+   uint8_t year, month;
+
+   // 2000 to 2099 only, checked before 'days' is narrowed,
+   // since time_t can be 64 bits.
+   if (t < (time_t) DS1302_EPOCH_2000)
+      return false;
+   t -= DS1302_EPOCH_2000;
+   if (t / SECS_PER_DAY >= 36525U)
+      return false;
+   days = t / SECS_PER_DAY;
+   secs = t % SECS_PER_DAY;
+
+   memset(p, 0, 8);
+   p[0] = bin2bcd(secs % 60);
+   p[1] = bin2bcd(secs / 60 % 60);
+   p[2] = bin2bcd(secs / 3600);                 // 24 hour format
+   p[5] = (days + 6) % 7 + 1;                   // 2000-01-01 was a Saturday
+
+   // Four years are 1461 days, starting with a leap year.
+   year = days / 1461 * 4;
+   days %= 1461;
+   if (days >= 366)
+    { days -= 366;
+      year += 1 + days / 365;
+      days %= 365;
+    }
+   leap = (year & 3) == 0;
+
+   for (month = 12; month > 1; month--)
+      if (days >= pgm_read_word(&monthDays[month - 1]) + (month > 2 ? leap : 0))
+         break;
+   days -= pgm_read_word(&monthDays[month - 1]) + (month > 2 ? leap : 0);
+
+   p[3] = bin2bcd(days + 1);
+   p[4] = bin2bcd(month);
+   p[6] = bin2bcd(year);
+   return true;
+ }
+
+
+// Convert the Time library format to the clock registers,
+// in 24 hour format.
+static void encode(const tmElements_t &tm, ds1302_struct &rtc)
+ { // Fill the structure with zeros to make 
+   // any unused bits zero
+   memset ((char *) &rtc, 0, sizeof(rtc));
+   rtc.Seconds = bin2bcd_l(tm.Second);
+   rtc.Seconds10 = bin2bcd_h(tm.Second);
+   rtc.Minutes = bin2bcd_l(tm.Minute);
+   rtc.Minutes10 = bin2bcd_h(tm.Minute);
+   rtc.h24.hour_12_24 = 0;
+   rtc.h24.Hour = bin2bcd_l(tm.Hour);
+   rtc.h24.Hour10 = bin2bcd_h(tm.Hour);
+   rtc.Day = bin2bcd_l(tm.Wday);
+   rtc.Date = bin2bcd_l(tm.Day);
+   rtc.Date10 = bin2bcd_h(tm.Day);
+   rtc.Month = bin2bcd_l(tm.Month);
+   rtc.Month10 = bin2bcd_h(tm.Month);
+   rtc.Year = bin2bcd_l(tm.Year - (2000 - 1970));
+   rtc.Year10 = bin2bcd_h(tm.Year - (2000 - 1970));
+ }
+
  
 // --------------------------------------------------------
 // Static variables
 // --------------------------------------------------------
 
-bool DS1302RTC::exists = false;
+DS1302RTC *DS1302RTC::primary = 0;
 
-uint8_t DS1302RTC::io = 0;
-uint8_t DS1302RTC::sclk = 0;
-uint8_t DS1302RTC::rst = 0; 
+volatile bool DS1302RTC::engineRunning = false;
+DS1302RTC * volatile DS1302RTC::asyncOwner = 0;
+DS1302Transaction * volatile DS1302RTC::queueHead = 0;
+DS1302Transaction *DS1302RTC::queueTail = 0;
+#ifdef DS1302RTC_THREADSAFE
+DS1302Mutex DS1302RTC::mutex;
+#endif
  
 // --------------------------------------------------------
 // DS1302RTC Constructor
 // --------------------------------------------------------
  
-DS1302RTC::DS1302RTC(uint8_t _io, uint8_t _sclk, uint8_t _rst)
- { io = _io;
-   sclk = _sclk;
-   rst = _rst;
+#ifdef ARDUINO
+DS1302RTC::DS1302RTC(uint8_t io, uint8_t sclk, uint8_t rst)
+ { pins.setPins(io, sclk, rst);
+   bus = &pins;
+   init();
+ }
+#endif
+
+DS1302RTC::DS1302RTC(DS1302Bus &_bus)
+ { bus = &_bus;
+   init();
+ }
+
+void DS1302RTC::init()
+ { cacheResync = 0;
+   cacheValid = false;
+   cacheVerified = false;
+   cacheTime = 0;
+   cacheMillis = 0;
+   cacheEdge = false;
+   edgeMicros = 0;
+
+   asyncState = DS1302_ASYNC_IDLE;
+
+   lowPower = false;
+
+   driftRef = 0;
+   driftError = 0;
+   driftPpb = 0;
+   driftThreshold = DS1302_DRIFT_THRESHOLD;
+
+#ifdef DS1302RTC_STATS
+   clearStats();
+#endif
+
+#ifdef DS1302RTC_THREADSAFE
+   mutex.init();
+   memset((void *) snap, 0, sizeof(snap));
+   snapSeq = 0;
+   snapBegin = 0;
+#endif
+
+   wp = DS1302_WP_UNKNOWN;
+   protect = false;
+   trickle = 0;
+   trickleKnown = false;
+
+   // The first chip is the one of the static get().
+   if (primary == 0)
+      primary = this;
     
    exists = true;
  }
 
+// --------------------------------------------------------
+// DS1302RTC::get
+//
+// The time of the first DS1302RTC object, as sync provider
+// for the Time library: setSyncProvider(RTC.get)
+//
 time_t DS1302RTC::get()
- { tmElements_t tm;
-   read(tm);
-   return makeTime(tm);
+ { return primary != 0 ? primary->now() : 0;
+ }
+
+time_t DS1302RTC::now()
+ { DS1302_LOCK(mutex);
+   time_t t;
+   uint32_t ms;
+   bool boundary = false;
+
+   ms = millis();
+   if (cacheValid && ms - cacheMillis < cacheResync)
+    { t = cacheTime + (ms - cacheMillis) / 1000;
+
+      // The millis() anchor is somewhere inside the second
+      // that was read, so the first second boundary after a
+      // resync is confirmed on the chip before it's trusted.
+      if (cacheVerified || t == cacheTime)
+       { DS1302_STAT(statistics.cacheHits++);
+         t = correct(t);
+#ifdef DS1302RTC_THREADSAFE
+         publish(t, ms);
+#endif
+         return t;
+       }
+      boundary = true;
+    }
+
+   DS1302_STAT(statistics.cacheMisses++);
+   t = getEpoch();
+
+   // 0 is a failed read, which is not cached.
+   if (cacheResync != 0 && t != 0)
+    { cacheVerified = boundary && t == cacheTime + (ms - cacheMillis) / 1000;
+      cacheTime = t;
+      cacheMillis = ms;
+      cacheValid = true;
+      cacheEdge = false;
+    }
+   if (t == 0)
+      return 0;
+
+   t = correct(t);
+#ifdef DS1302RTC_THREADSAFE
+   publish(t, ms);
+#endif
+   return t;
  }
+
+#ifdef DS1302RTC_THREADSAFE
+// --------------------------------------------------------
+// DS1302RTC::publish, lastTime
+//
+// A sequence lock over two copies. The writer fills the copy
+// that is not valid and then counts on, so a reader that
+// interrupts the writer still finds a whole copy.
+// The copy that a reader uses is only written again by the
+// second update after it, which is announced in snapBegin.
+// The writers are one at a time, because of the mutex.
+//
+void DS1302RTC::publish(time_t t, uint32_t ms)
+ { uint32_t seq = snapSeq + 1;
+
+   snapBegin = seq;
+   DS1302_BARRIER();
+   snap[seq & 1].time = t;
+   snap[seq & 1].millis = ms;
+   DS1302_BARRIER();
+   snapSeq = seq;
+ }
+
+time_t DS1302RTC::lastTime(uint32_t *at) const
+ { uint32_t seq;
+   time_t t;
+   uint32_t ms;
+
+   do
+    { seq = snapSeq;
+      DS1302_BARRIER();
+      t = snap[seq & 1].time;
+      ms = snap[seq & 1].millis;
+      DS1302_BARRIER();
+    } while (snapBegin - seq >= 2);
+
+   if (at != 0)
+      *at = ms;
+   return t;
+ }
+
+bool DS1302RTC::lastTime(tmElements_t &tm) const
+ { time_t t = lastTime();
+
+   if (t == 0)
+      return false;
+   breakTime(t, tm);
+   return true;
+ }
+#endif
  
+void DS1302RTC::setCache(uint32_t resync)
+ { DS1302_LOCK(mutex);
+   cacheResync = resync;
+   cacheValid = false;
+ }
+
+// --------------------------------------------------------
+// DS1302RTC::syncToSecondEdge
+//
+// Wait for the next second by reading only the seconds register,
+// and anchor the cache at that moment.
+// The edge is between the start of the last two reads,
+// the middle of the two is taken, so the error is less than
+// half a single register read.
+// This blocks for up to 'timeout' milliseconds. A clock that
+// doesn't read as valid (no chip) fails before the wait.
+//
+bool DS1302RTC::syncToSecondEdge(uint16_t timeout)
+ { DS1302_LOCK(mutex);
+   uint8_t regs[8], first, second;
+   uint32_t start, before, last;
+
+   if (!readClock(regs))
+      return false;            // no chip, or no valid time
+
+   start = millis();
+   last = micros();
+   first = read(DS1302_SECONDS);
+   if (bitRead(first, DS1302_CH))
+      return false;            // the clock is halted
+
+   do
+    { before = micros();
+      second = read(DS1302_SECONDS);
+      if (second != first)
+         break;
+      last = before;
+    } while (millis() - start < timeout);
+
+   if (second == first)
+      return false;
+
+   edgeMicros = last + (before - last) / 2;
+   cacheMillis = millis() - (micros() - edgeMicros) / 1000;
+   cacheTime = getEpoch();
+   if (cacheTime == 0)
+    { cacheValid = false;
+      return false;
+    }
+   cacheValid = true;
+   cacheVerified = true;
+   cacheEdge = true;
+
+   return true;
+ }
+
+// --------------------------------------------------------
+// DS1302RTC::getMillisEpoch
+//
+// Milliseconds since 1970, counted on from the second edge.
+// micros() runs over after 71 minutes, after that the
+// elapsed time is taken from millis().
+//
+uint64_t DS1302RTC::getMillisEpoch()
+ { DS1302_LOCK(mutex);
+   uint32_t ms;
+
+   ms = millis() - cacheMillis;
+   if (!cacheValid || !cacheEdge || (cacheResync != 0 && ms >= cacheResync))
+    { if (!syncToSecondEdge())
+       { time_t t = getEpoch();
+
+         return t != 0 ? (uint64_t) correct(t) * 1000 : 0;
+       }
+      ms = 0;
+    }
+
+   if (ms < 4000000UL)
+      ms = (micros() - edgeMicros) / 1000;
+   else
+      ms = millis() - cacheMillis;
+
+   return (uint64_t) correct(cacheTime) * 1000 + ms;
+ }
+
+// --------------------------------------------------------
+// DS1302RTC::millisUntil
+//
+// Without a second edge anchor, the cache is up to a second
+// behind the chip, that second is taken off.
+//
+uint32_t DS1302RTC::millisUntil(time_t t)
+ { DS1302_LOCK(mutex);
+   uint64_t at, target;
+   uint32_t ms;
+
+   ms = millis() - cacheMillis;
+   if (cacheValid && (cacheResync != 0 ? ms < cacheResync : cacheEdge))
+    { at = (uint64_t) correct(cacheTime) * 1000 + ms;
+      if (!cacheEdge)
+         at += 999;
+    }
+   else
+      at = (uint64_t) now() * 1000 + 999;
+
+   target = (uint64_t) t * 1000;
+   if (target <= at)
+      return 0;
+   return (uint32_t) (target - at);
+ }
+
+// --------------------------------------------------------
+// DS1302RTC::syncTo
+//
+// The first reference is the anchor, later ones give the drift
+// over the time since the anchor, once that is long enough
+// for the one second resolution of the chip.
+//
+// A division rounded to the nearest, for both signs.
+static int64_t divRound(int64_t a, int64_t b)
+ { if ((a < 0) != (b < 0))
+      return (a - b / 2) / b;
+   return (a + b / 2) / b;
+ }
+
+bool DS1302RTC::syncTo(time_t reference)
+ { DS1302_LOCK(mutex);
+   time_t t, anchor;
+   int32_t error;
+
+   t = getEpoch();
+   if (t == 0)
+      return false;
+   error = (int32_t) (t - reference);
+
+   if (driftRef == 0)
+    { driftRef = reference;
+      driftError = error;
+    }
+   else if (reference - driftRef >= DS1302_DRIFT_MIN_SPAN)
+      driftPpb = divRound((int64_t) (error - driftError) * 1000000000LL,
+                          (int32_t) (reference - driftRef));
+
+   // The step of the chip is taken into the anchor error,
+   // so the next drift estimate still covers the whole time.
+   if (error >= (int32_t) driftThreshold || -error >= (int32_t) driftThreshold)
+    { anchor = driftRef;
+      if (!set(reference))
+         return false;
+      driftRef = anchor;
+      driftError -= error;
+    }
+   return true;
+ }
+
+// --------------------------------------------------------
+// DS1302RTC::correct
+//
+// The chip time minus the error at the anchor,
+// and minus the drift since then.
+//
+time_t DS1302RTC::correct(time_t t)
+ { int32_t elapsed;
+
+   if (driftRef == 0)
+      return t;
+
+   elapsed = (int32_t) (t - driftRef);
+   return t - driftError - (time_t) divRound((int64_t) elapsed * driftPpb, 1000000000LL);
+ }
+
 bool DS1302RTC::set(time_t t)
- { tmElements_t tm;
-   breakTime(t, tm);
-   return write(tm);
+ { DS1302_LOCK(mutex);
+   uint8_t regs[8];
+
+   if (!encodeEpoch(t, regs))
+      return false;
+   writeClock(regs);
+
+   return true;
+ }
+
+// --------------------------------------------------------
+// DS1302RTC::getEpoch
+//
+// Read the time from the chip, without the cache.
+// Returns 0 if the chip doesn't give a valid time.
+//
+time_t DS1302RTC::getEpoch()
+ { DS1302_LOCK(mutex);
+   uint8_t regs[8];
+
+   if (!readClock(regs))
+      return 0;
+   return epoch(regs);
  }
 
 bool DS1302RTC::read(tmElements_t &tm)
- { ds1302_struct rtc;
-   clock_burst_read((uint8_t *) &rtc);
- 
-   tm.Second = bcd2bin(rtc.Seconds10, rtc.Seconds);
-   tm.Minute = bcd2bin(rtc.Minutes10, rtc.Minutes);
-   if (rtc.h24.hour_12_24 == 0)
-      tm.Hour = bcd2bin(rtc.h24.Hour10, rtc.h24.Hour);
-   else
-      tm.Hour = bcd2bin(rtc.h12.Hour10, rtc.h12.Hour) + rtc.h12.AM_PM?12:0;
-   tm.Wday = rtc.Day;
-   tm.Day = bcd2bin(rtc.Date10, rtc.Date);
-   tm.Month = bcd2bin(rtc.Month10, rtc.Month);
-   tm.Year = bcd2bin(rtc.Year10, rtc.Year) + (2000 - 1970);
+ { DS1302_LOCK(mutex);
+   uint8_t regs[8];
+
+   if (!readClock(regs))
+      return false;
+   decode(regs, tm);
  
    return true;
  }
 
+
+// --------------------------------------------------------
+// DS1302RTC::readClock
+//
+// A clock burst read, that is only done again
+// when the data is not valid.
+//
+bool DS1302RTC::readClock(uint8_t *p)
+ { uint8_t i;
+
+   for (i = 0; i <= DS1302RTC_READ_RETRIES; i++)
+    { clock_burst_read(p);
+      if (valid(p))
+         return true;
+      DS1302_STAT(statistics.retries++);
+    }
+   return false;
+ }
+
 bool DS1302RTC::write(tmElements_t &tm)
+ { DS1302_LOCK(mutex);
+   ds1302_struct rtc;
+
+   encode(tm, rtc);
+   writeClock((uint8_t *) &rtc);
+
+   return true;
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::writeClock
+//
+// Write the clock registers with a burst,
+// 'p' points to 8 bytes.
+//
+void DS1302RTC::writeClock(uint8_t *p)
  { // Start by clearing the Write Protect bit
    // Otherwise the clock data cannot be written
    // The whole register is written, 
    // but the WP-bit is the only bit in that register.
-   write (DS1302_ENABLE, 0);
+   // It's only written if it isn't known to be cleared already.
+   unprotect();
+
+   // The 8th byte of the burst is the Enable register,
+   // so the Write Protect can be set again for free.
+   p[7] = protect ? bit(DS1302_WP) : 0;
+
+   clock_burst_write(p);
+   wp = protect ? DS1302_WP_SET : DS1302_WP_CLEAR;
+
+   // The next get() reads the new time,
+   // and the drift anchor is no longer valid.
+   cacheValid = false;
+   driftRef = 0;
+ }
 
-   // Disable Trickle Charger.
-   write (DS1302_TRICKLE, 0x00);
  
-   ds1302_struct rtc;
-   // Fill the structure with zeros to make 
-   // any unused bits zero
-   memset ((char *) &rtc, 0, sizeof(rtc));
-   rtc.Seconds = bin2bcd_l(tm.Second);
-   rtc.Seconds10 = bin2bcd_h(tm.Second);
-   rtc.Minutes = bin2bcd_l(tm.Minute);
-   rtc.Minutes10 = bin2bcd_h(tm.Minute);
-   rtc.h24.hour_12_24 = 0;
-   rtc.h24.Hour = bin2bcd_l(tm.Hour);
-   rtc.h24.Hour10 = bin2bcd_h(tm.Hour);
-   rtc.Day = bin2bcd_l(tm.Wday);
-   rtc.Date = bin2bcd_l(tm.Day);
-   rtc.Date10 = bin2bcd_h(tm.Day);
-   rtc.Month = bin2bcd_l(tm.Month);
-   rtc.Month10 = bin2bcd_h(tm.Month);
-   rtc.Year = bin2bcd_l(tm.Year - (2000 - 1970));
-   rtc.Year10 = bin2bcd_h(tm.Year - (2000 - 1970));
-    
-   clock_burst_write((uint8_t *) &rtc);
+// --------------------------------------------------------
+// DS1302RTC::setSeconds, setHMS, adjust
+//
+// Change only a part of the time.
+// Only the registers that change are written, each with
+// its own transaction, unless a burst is faster.
+// Between single writes, the time in the chip is not consistent;
+// the seconds are written last.
+// A value out of range is refused before anything is written.
+//
+bool DS1302RTC::setSeconds(uint8_t second)
+ { DS1302_LOCK(mutex);
+   uint8_t regs[8];
+
+   if (second > 59)
+      return false;
+
+   regs[0] = bin2bcd(second);
+   return update(0, regs, 0x01);
+ }
+
+bool DS1302RTC::setHMS(uint8_t hour, uint8_t minute, uint8_t second)
+ { DS1302_LOCK(mutex);
+   uint8_t regs[8];
+
+   if (hour > 23 || minute > 59 || second > 59)
+      return false;
+
+   regs[0] = bin2bcd(second);
+   regs[1] = bin2bcd(minute);
+   regs[2] = bin2bcd(hour);        // 24 hour format
+   return update(0, regs, 0x07);
+ }
+
+bool DS1302RTC::adjust(int32_t seconds)
+ { DS1302_LOCK(mutex);
+   uint8_t old[8], regs[8];
+
+   if (!readClock(old))
+      return false;
+   if (!encodeEpoch(epoch(old) + seconds, regs))
+      return false;
+
+   return update(old, regs, 0x7F);
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::update
+//
+// Write the clock registers selected by 'mask' (bit 0 is
+// the seconds) with the values in 'regs'.
+// If the current register values 'old' are known,
+// registers with the same value are skipped, and the other
+// registers are known for a burst write.
+//
+bool DS1302RTC::update(const uint8_t *old, uint8_t *regs, uint8_t mask)
+ { uint8_t i, count;
+
+   count = 0;
+   for (i = 0; i < 7; i++)
+    { if (old != 0 && old[i] == regs[i])
+         bitClear(mask, i);
+      if (bitRead(mask, i))
+         count++;
+    }
+   if (count == 0)
+      return true;
+
+   unprotect();
+
+   if (old != 0 && DS1302_COST_NS(9, 1) < DS1302_COST_NS(2 * count, count))
+    { for (i = 0; i < 7; i++)
+         if (!bitRead(mask, i))
+            regs[i] = old[i];
+      regs[7] = protect ? bit(DS1302_WP) : 0;
+      clock_burst_write(regs);
+      wp = protect ? DS1302_WP_SET : DS1302_WP_CLEAR;
+    }
+   else
+    { for (i = 7; i-- > 0; )
+         if (bitRead(mask, i))
+            write(DS1302_SECONDS + 2 * i, regs[i]);
+      if (protect)
+         setWriteProtect(true);
+    }
+
+   cacheValid = false;
+   driftRef = 0;
+   return true;
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::beginRead
+//
+// Start a clock burst read that is done in small steps
+// by poll(), one byte per call.
+// The DS1302 is fully static, so the bus may wait
+// between the steps as long as needed.
+// Don't use the other functions until the read is finished.
+//
+// The read owns the bus until the last poll(), CE stays high.
+// Until then the sessions of all objects are refused, and with
+// DS1302RTC_THREADSAFE the mutex is held, so the other tasks
+// wait. poll() must then be called from the same task.
+//
+// Returns false if a read is already busy, or while the
+// background engine owns the bus.
+//
+bool DS1302RTC::beginRead()
+ { DS1302_LOCK(mutex);
+   if (engineRunning || asyncOwner != 0)
+      return false;
+   if (asyncState != DS1302_ASYNC_IDLE && asyncState != DS1302_ASYNC_DONE)
+      return false;
+
+#ifdef DS1302RTC_THREADSAFE
+   mutex.lock();               // until the last poll()
+#endif
+   asyncOwner = this;
+   bus->start();
+   asyncState = DS1302_ASYNC_COMMAND;
+   DS1302_STAT(count(8));
+   return true;
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::poll
+//
+// Do the next step of the read started by beginRead().
+//
+// Returns true when no read is busy anymore.
+// The background engine doesn't start a transaction
+// while the read owns the bus.
+//
+bool DS1302RTC::poll()
+ { DS1302_LOCK(mutex);
+   if (asyncState == DS1302_ASYNC_IDLE || asyncState == DS1302_ASYNC_DONE)
+      return true;
+
+   if (asyncState == DS1302_ASYNC_COMMAND)
+      bus->togglewrite(DS1302_CLOCK_BURST_READ, true);
+   else
+      asyncBuf[asyncState - DS1302_ASYNC_DATA] = bus->toggleread();
+
+   if (++asyncState == DS1302_ASYNC_DONE)
+    { bus->stop();
+      if (lowPower)
+         bus->end();
+      asyncOwner = 0;
+#ifdef DS1302RTC_THREADSAFE
+      mutex.unlock();          // taken by beginRead()
+#endif
+      return true;
+    }
+   return false;
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::result
+//
+// Get the time of a finished beginRead()/poll() sequence.
+//
+// Returns false if there is no finished read.
+//
+bool DS1302RTC::result(tmElements_t &tm)
+ { DS1302_LOCK(mutex);
+   if (asyncState != DS1302_ASYNC_DONE)
+      return false;
+
+   asyncState = DS1302_ASYNC_IDLE;
+   if (!valid(asyncBuf))
+      return false;
+   decode(asyncBuf, tm);
+   return true;
+ }
+
+ 
+// --------------------------------------------------------
+// DS1302RTC::readRAM
+//
+// Read 'length' bytes of the ram, starting at 'offset'.
+//
+// A burst always starts at the first byte of the ram,
+// so the bytes before 'offset' are clocked out as well.
+// The burst is only used if that is still the faster way.
+//
+bool DS1302RTC::readRAM(uint8_t *p, uint8_t offset, uint8_t length)
+ { DS1302_LOCK(mutex);
+   uint8_t buf[DS1302_RAMSIZE];
+   uint8_t i;
+
+   if (offset + length > DS1302_RAMSIZE)
+      return false;
+
+   if (length > 1 &&
+       DS1302_COST_NS(1 + offset + length, 1) < DS1302_COST_NS(2 * length, length))
+    { transfer(DS1302_RAM_BURST_READ, buf, offset + length);
+      memcpy(p, buf + offset, length);
+    }
+   else
+    { for (i = 0; i < length; i++)
+         p[i] = read(DS1302_RAMSTART + 2 * (offset + i));
+    }
+   return true;
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::writeRAM
+//
+// Write 'length' bytes to the ram, starting at 'offset'.
+//
+// Unlike the clock burst, a ram burst may stop after any byte.
+// But it also starts at the first byte, so with an offset
+// the bytes before it are read first and written back.
+//
+bool DS1302RTC::writeRAM(const uint8_t *p, uint8_t offset, uint8_t length)
+ { DS1302_LOCK(mutex);
+   uint8_t buf[DS1302_RAMSIZE];
+   uint8_t i;
+
+   if (offset + length > DS1302_RAMSIZE)
+      return false;
+   if (length == 0)
+      return true;
+
+   // The ram can only be written with the Write Protect bit cleared.
+   unprotect();
+
+   if (offset == 0 ||
+       DS1302_COST_NS(2 + 2 * offset + length, 2) < DS1302_COST_NS(2 * length, length))
+    { if (offset != 0)
+         transfer(DS1302_RAM_BURST_READ, buf, offset);
+      memcpy(buf + offset, p, length);
+      transfer(DS1302_RAM_BURST_WRITE, buf, offset + length);
+    }
+   else
+    { for (i = 0; i < length; i++)
+         write(DS1302_RAMSTART + 2 * (offset + i), p[i]);
+    }
+
+   if (protect)
+      write (DS1302_ENABLE, bit(DS1302_WP));
+   return true;
+ }
+
+ 
+// --------------------------------------------------------
+// DS1302RTC::setWriteProtect
+//
+// Set or clear the Write Protect bit.
+// While it is set, a time write costs one extra transaction
+// to clear it, but setting it again is part of the burst.
+//
+void DS1302RTC::setWriteProtect(bool on)
+ { DS1302_LOCK(mutex);
+   protect = on;
+
+   if (wp != (on ? DS1302_WP_SET : DS1302_WP_CLEAR))
+      write (DS1302_ENABLE, on ? bit(DS1302_WP) : 0);
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::setTrickleCharger, getTrickleCharger
+//
+// The Trickle Register is: TCS (1010 = on), DS (01 = one diode,
+// 10 = two diodes), RS (01 = 2k, 10 = 4k, 11 = 8k).
+// Every other value turns the charger off.
+//
+bool DS1302RTC::setTrickleCharger(uint8_t diodes, uint8_t resistor)
+ { DS1302_LOCK(mutex);
+   uint8_t value, rs;
 
+   if (diodes == 0)
+      value = 0x00;
+   else
+    { if (diodes > 2)
+         return false;
+      switch (resistor)
+       { case 2: rs = 1; break;
+         case 4: rs = 2; break;
+         case 8: rs = 3; break;
+         default: return false;
+       }
+      value = DS1302_TCS_ON | (diodes << DS1302_DS0) | (rs << DS1302_ROUT0);
+    }
+
+   if (trickleKnown && trickle == value)
+      return true;
+
+   unprotect();
+   write (DS1302_TRICKLE, value);
+   if (protect)
+      write (DS1302_ENABLE, bit(DS1302_WP));
+
+   return true;
+ }
+
+bool DS1302RTC::getTrickleCharger(uint8_t &diodes, uint8_t &resistor)
+ { DS1302_LOCK(mutex);
+   uint8_t rs;
+
+   if (!trickleKnown)
+    { trickle = read(DS1302_TRICKLE);
+      trickleKnown = true;
+    }
+
+   diodes = (trickle >> DS1302_DS0) & 0x03;
+   rs = (trickle >> DS1302_ROUT0) & 0x03;
+   if ((trickle & 0xF0) != DS1302_TCS_ON || diodes == 0 || diodes == 3 || rs == 0)
+    { diodes = 0;
+      resistor = 0;
+      return false;
+    }
+
+   resistor = 1 << rs;         // 2, 4, 8 kOhm
    return true;
  }
 
+
+// --------------------------------------------------------
+// DS1302RTC::unprotect
+//
+// Clear the Write Protect bit, unless it's known to be cleared.
+//
+void DS1302RTC::unprotect()
+ { if (wp != DS1302_WP_CLEAR)
+      write (DS1302_ENABLE, 0);
+ }
+
+ 
+// --------------------------------------------------------
+// DS1302RTC::begin
+//
+// Set up the bus once, so the sessions don't have to.
+// Without it, the first session does it.
+// Returns whether the chip answers, see chipPresent().
+//
+bool DS1302RTC::begin()
+ { DS1302_LOCK(mutex);
+   bus->begin();
+   exists = probe();
+   return exists;
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::end
+//
+// Release the pins, for example before the sleep mode.
+//
+void DS1302RTC::end()
+ { DS1302_LOCK(mutex);
+   bus->end();
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::probe
+//
+// Write the inverted value of the last ram byte,
+// read it back, and restore it.
+// Without a chip, the I/O-line reads the same pattern
+// whatever is written.
+//
+bool DS1302RTC::probe()
+ { uint8_t address, old, check;
+
+   address = DS1302_RAMSTART + 2 * (DS1302_RAMSIZE - 1);
+   old = read(address);
+
+   unprotect();
+   write(address, ~old);
+   check = read(address);
+   write(address, old);
+   if (protect)
+      write(DS1302_ENABLE, bit(DS1302_WP));
+
+   return check == (uint8_t) ~old;
+ }
+
  
 void DS1302RTC::halt()
- { write (DS1302_ENABLE, 0x00);
+ { DS1302_LOCK(mutex);
+   write (DS1302_ENABLE, 0x00);
  }
  
  
@@ -313,18 +1170,9 @@ void DS1302RTC::halt()
 // also the pinMode is set.
 //
 void DS1302RTC::clock_burst_read(uint8_t *p)
- { int i;
-
-   start();
-
-   // Instead of the address,
+ { // Instead of the address,
    // the CLOCK_BURST_READ command is issued
-   // the I/O-line is released for the data
-   togglewrite(DS1302_CLOCK_BURST_READ, true);
-
-   for (i = 0; i < 8; i++)
-      *p++ = toggleread();
-   stop();
+   transfer(DS1302_CLOCK_BURST_READ, p, 8);
  }
 
 
@@ -338,20 +1186,9 @@ void DS1302RTC::clock_burst_read(uint8_t *p)
 // also the pinMode is set.
 //
 void DS1302RTC::clock_burst_write(uint8_t *p)
- { int i;
-
-   start();
-
-   // Instead of the address,
+ { // Instead of the address,
    // the CLOCK_BURST_WRITE command is issued.
-   // the I/O-line is not released
-   togglewrite(DS1302_CLOCK_BURST_WRITE, false);
-
-   for (i = 0; i < 8; i++)
-    { // the I/O-line is not released
-      togglewrite(*p++, false);
-    }
-   stop();
+   transfer(DS1302_CLOCK_BURST_WRITE, p, 8);
  }
 
 
@@ -373,11 +1210,7 @@ uint8_t DS1302RTC::read(int address)
    // set lowest bit (read bit) in address
    bitSet(address, DS1302_READBIT);
 
-   start();
-   // the I/O-line is released for the data
-   togglewrite(address, true);
-   data = toggleread();
-   stop();
+   transfer(address, &data, 1);
 
    return (data);
  }
@@ -398,119 +1231,221 @@ void DS1302RTC::write(int address, uint8_t data)
  { // clear lowest bit (read bit) in address
    bitClear(address, DS1302_READBIT);
 
-   start();
-   // don't release the I/O-line
-   togglewrite(address, false);
-   // don't release the I/O-line
-   togglewrite(data, false);
-   stop();
+   transfer(address, &data, 1);
+
+   // Remember the state of the control registers,
+   // to avoid writing them again with the same value.
+   if (address == DS1302_ENABLE)
+      wp = bitRead(data, DS1302_WP) ? DS1302_WP_SET : DS1302_WP_CLEAR;
+   else if (address == DS1302_TRICKLE)
+    { trickle = data;
+      trickleKnown = true;
+    }
  }
 
 
 // --------------------------------------------------------
-// DS1302RTC::start
+// DS1302RTC::transfer
 //
-// A helper function to setup the start condition.
+// One complete session: the command byte, followed by
+// 'length' data bytes.
+// The read bit of the command selects the direction.
 //
-// An 'init' function is not used.
-// But now the pinMode is set every time.
-// That's not a big deal, and it's valid.
-// At startup, the pins of the Arduino are high impedance.
-// Since the DS1302 has pull-down resistors,
-// the signals are low (inactive) until the DS1302 is used.
-void DS1302RTC::start(void)
- { digitalWrite(rst, LOW);  // default, not enabled
-   pinMode(rst, OUTPUT);
+// While the background engine runs, the session is put
+// in its queue and this function waits for it.
+//
+void DS1302RTC::transfer(uint8_t command, uint8_t *p, uint8_t length)
+ { // A session now would corrupt the busy read of beginRead().
+   // A refused read gives zeros, which is not a valid time.
+   if (asyncOwner != 0)
+    { if (bitRead(command, DS1302_READBIT))
+         memset(p, 0, length);
+      return;
+    }
 
-   digitalWrite(sclk, LOW);  // default, clock low
-   pinMode(sclk, OUTPUT);
+   if (engineRunning)
+    { DS1302Transaction t;
 
-   pinMode(io, OUTPUT);
+      t.command = command;
+      t.data = p;
+      t.length = length;
+      t.callback = 0;
+      enqueue(t);
+      while (!t.done)
+         ;
+      if (lowPower)
+       { noInterrupts();
+         if (queueHead == 0)
+            bus->end();
+         interrupts();
+       }
+      return;
+    }
 
-   digitalWrite(rst, HIGH);  // start the session
-   delayMicroseconds(4);            // tCC = 4us
+   DS1302_STAT(count(length));
+   bus->transfer(command, p, length);
+   if (lowPower)
+      bus->end();
  }
 
 
+#ifdef DS1302RTC_STATS
 // --------------------------------------------------------
-// DS1302RTC::stop
+// DS1302RTC::count, clearStats
 //
-// A helper function to finish the communication.
+// Count a session with 'length' data bytes.
 //
-void DS1302RTC::stop(void)
- { // Set CE low
-   digitalWrite(rst, LOW);
-   delayMicroseconds(4);            // tCWH = 4us
+void DS1302RTC::count(uint8_t length)
+ { uint32_t ns;
+
+   statistics.sessions++;
+   statistics.bytes += length + 1;
+
+   ns = DS1302_COST_NS(length + 1, 1) + busyNs;
+   statistics.busyMicros += ns / 1000;
+   busyNs = ns % 1000;
  }
 
+void DS1302RTC::clearStats()
+ { memset(&statistics, 0, sizeof(statistics));
+   busyNs = 0;
+ }
+#endif
+
 
 // --------------------------------------------------------
-// DS1302RTC::toggleread
-//
-// A helper function for reading a byte with bit toggle
+// DS1302RTC::beginEngine
 //
-// This function assumes that the SCLK is still high.
+// Start the background engine.
+// From now on the bus is only used by service(),
+// which should be called from a timer interrupt.
+// With DS1302RTC_ENGINE_TIMER2 on AVR, Timer2 is set up
+// for that at DS1302RTC_ENGINE_HZ.
 //
-uint8_t DS1302RTC::toggleread(void)
- { uint8_t i, data;
+void DS1302RTC::beginEngine()
+ { engineRunning = true;
 
-   data = 0;
-   for (i = 0; i <= 7; i++)
-    { // Issue a clock pulse for the next databit.
-      // If the 'togglewrite' function was used before
-      // this function, the SCLK is already high.
-      digitalWrite(sclk, HIGH);
-      delayMicroseconds(1);
+#if defined(DS1302RTC_ENGINE_TIMER2) && defined(TIMSK2)
+   TCCR2A = bit(WGM21);            // CTC mode
+   TCCR2B = bit(CS22);             // prescaler 64
+   OCR2A = F_CPU / 64 / DS1302RTC_ENGINE_HZ - 1;
+   TIMSK2 |= bit(OCIE2A);
+#endif
+ }
 
-      // Clock down, data is ready after some time.
-      digitalWrite(sclk, LOW);
-      delayMicroseconds(1);         // tCL=1000ns, tCDD=800ns
 
-      // read bit, and set it in place in 'data' variable
-      bitWrite(data, i, digitalRead(io));
-    }
-   return (data);
+// --------------------------------------------------------
+// DS1302RTC::endEngine
+//
+// Wait for the queue to run empty, and return to
+// using the bus directly.
+//
+void DS1302RTC::endEngine()
+ { while (queueHead != 0)
+      ;
+
+#if defined(DS1302RTC_ENGINE_TIMER2) && defined(TIMSK2)
+   TIMSK2 &= ~bit(OCIE2A);
+#endif
+
+   engineRunning = false;
  }
 
 
 // --------------------------------------------------------
-// DS1302RTC::togglewrite
+// DS1302RTC::enqueue
+//
+// Add a transaction to the queue of the background engine.
+// The transaction must stay valid until 'done' is set.
+// The callback, if any, is called from the interrupt.
 //
-// A helper function for writing a byte with bit toggle
+void DS1302RTC::enqueue(DS1302Transaction &t)
+ { DS1302_STAT(count(t.length));
+
+   t.bus = bus;
+   t.done = false;
+   t.pos = 0;
+   t.next = 0;
+
+   noInterrupts();
+   if (queueTail != 0)
+      queueTail->next = &t;
+   else
+      queueHead = &t;
+   queueTail = &t;
+   interrupts();
+ }
+
+
+// --------------------------------------------------------
+// DS1302RTC::service
 //
-// The 'release' parameter is for a read after this write.
-// It will release the I/O-line and will keep the SCLK high.
+// One step of the background engine, to be called from
+// a timer interrupt.
+// The first step starts the session and sends the command,
+// the next steps transfer one data byte each.
 //
-void DS1302RTC::togglewrite(uint8_t data, uint8_t release)
- { int i;
+void DS1302RTC::service()
+ { DS1302Transaction *t = queueHead;
+   void (*callback)(DS1302Transaction &);
+   uint8_t reading;
 
-   for (i = 0; i <= 7; i++)
-    { // set a bit of the data on the I/O-line
-      digitalWrite(io, bitRead(data, i));
-      delayMicroseconds(1);      // tDC = 200ns
+   // Not while a read of beginRead() owns the bus.
+   if (t == 0 || (t->pos == 0 && asyncOwner != 0))
+      return;
 
-      // clock up, data is read by DS1302
-      digitalWrite(sclk, HIGH);
-      delayMicroseconds(1);      // tCH = 1000ns, tCDH = 800ns
+   reading = bitRead(t->command, DS1302_READBIT);
+   if (t->pos == 0)
+    { t->bus->start();
+      t->bus->togglewrite(t->command, reading);
+    }
+   else if (reading)
+      t->data[t->pos - 1] = t->bus->toggleread();
+   else
+      t->bus->togglewrite(t->data[t->pos - 1], false);
 
-      if (release && i == 7)
-       { // If this write is followed by a read,
-         // the I/O-line should be released after
-         // the last bit, before the clock line is made low.
-         // This is according the datasheet.
-         // I have seen other programs that don't release
-         // the I/O-line at this moment,
-         // and that could cause a shortcut spike
-         // on the I/O-line.
-         pinMode(io, INPUT);
+   if (t->pos++ == t->length)
+    { t->bus->stop();
 
-         // For Arduino 1.0.3, removing the pull-up is no longer needed.
-         // Setting the pin as 'INPUT' will already remove the pull-up.
-         // digitalWrite (DS1302_IO, LOW); // remove any pull-up
-       }
+      queueHead = t->next;
+      if (queueHead == 0)
+         queueTail = 0;
+
+      // The transaction may be gone as soon as it is done (that of
+      // transfer() is on its stack), so that is set last, after
+      // the callback.
+      callback = t->callback;
+      if (callback)
+         callback(*t);
+      DS1302_BARRIER();
+      t->done = true;
+    }
+ }
+
+#if defined(DS1302RTC_ENGINE_TIMER2) && defined(TIMSK2)
+ISR(TIMER2_COMPA_vect)
+ { DS1302RTC::service();
+ }
+#endif
+
+
+// --------------------------------------------------------
+// DS1302Bus::transfer
+//
+// One session with the bit-level primitives.
+//
+void DS1302Bus::transfer(uint8_t command, uint8_t *p, uint8_t length)
+ { uint8_t i;
+   uint8_t reading = bitRead(command, DS1302_READBIT);
+
+   start();
+   // For a read, the I/O-line is released for the data
+   togglewrite(command, reading);
+   for (i = 0; i < length; i++)
+    { if (reading)
+         p[i] = toggleread();
       else
-       { digitalWrite(sclk, LOW);
-         delayMicroseconds(1);        // tCL=1000ns, tCDD=800ns
-       }
+         togglewrite(p[i], false);   // the I/O-line is not released
     }
- }
\ No newline at end of file
+   stop();
+ }
@@ -6,37 +6,354 @@
 #ifndef DS1302RTC_h
 #define DS1302RTC_h
 
+#ifdef ARDUINO
 #include <Time.h>
+#include "DS1302PinBus.h"
+#else
+#include <TimeLib.h>
+#include "DS1302Bus.h"
+#endif
+
+// The background engine can run from Timer2 on AVR.
+// Timer2 is also used by tone(), so it is not enabled by default.
+// Without it, call DS1302RTC::service() from any timer interrupt.
+// #define DS1302RTC_ENGINE_TIMER2
+#ifndef DS1302RTC_ENGINE_HZ
+#define DS1302RTC_ENGINE_HZ 4000
+#endif
+
+// Define DS1302RTC_THREADSAFE for several FreeRTOS tasks:
+// the bus is used by one task at a time, and lastTime() gives
+// the time of the last now() without the bus.
+// #define DS1302RTC_THREADSAFE
+
+// Define DS1302RTC_STATS to count the bus use of every chip,
+// see DS1302RTC::stats(). Without it, the counters are not compiled.
+// #define DS1302RTC_STATS
+
+// Drift correction: the minimum time in seconds between two
+// references to estimate the drift, and the default error in
+// seconds at which the chip is set again.
+#ifndef DS1302_DRIFT_MIN_SPAN
+#define DS1302_DRIFT_MIN_SPAN 3600
+#endif
+#ifndef DS1302_DRIFT_THRESHOLD
+#define DS1302_DRIFT_THRESHOLD 2
+#endif
+
+// Number of extra clock reads when the data is not valid.
+#ifndef DS1302RTC_READ_RETRIES
+#define DS1302RTC_READ_RETRIES 2
+#endif
+
+// Size of the battery-backed ram.
+#define DS1302_RAMSIZE 31
+
+// Register names.
+// Since the highest bit is always '1',
+// the registers start at 0x80
+// If the register is read, the lowest bit should be '1'.
+#define DS1302_SECONDS           0x80
+#define DS1302_MINUTES           0x82
+#define DS1302_HOURS             0x84
+#define DS1302_DATE              0x86
+#define DS1302_MONTH             0x88
+#define DS1302_DAY               0x8A
+#define DS1302_YEAR              0x8C
+#define DS1302_ENABLE            0x8E
+#define DS1302_TRICKLE           0x90
+#define DS1302_CLOCK_BURST       0xBE
+#define DS1302_CLOCK_BURST_WRITE 0xBE
+#define DS1302_CLOCK_BURST_READ  0xBF
+#define DS1302_RAMSTART          0xC0
+#define DS1302_RAMEND            0xFC
+#define DS1302_RAM_BURST         0xFE
+#define DS1302_RAM_BURST_WRITE   0xFE
+#define DS1302_RAM_BURST_READ    0xFF
+
+
+// Defines for the bits, to be able to change
+// between bit number and binary definition.
+// By using the bit number, using the DS1302
+// is like programming an AVR microcontroller.
+// But instead of using "(1<<X)", or "_BV(X)",
+// the Arduino "bit(X)" is used.
+#define DS1302_D0 0
+#define DS1302_D1 1
+#define DS1302_D2 2
+#define DS1302_D3 3
+#define DS1302_D4 4
+#define DS1302_D5 5
+#define DS1302_D6 6
+#define DS1302_D7 7
+
+
+// Bit for reading (bit in address)
+#define DS1302_READBIT DS1302_D0 // READBIT=1: read instruction
+
+// Bit for clock (0) or ram (1) area,
+// called R/C-bit (bit in address)
+#define DS1302_RC DS1302_D6
+
+// Seconds Register
+#define DS1302_CH DS1302_D7   // 1 = Clock Halt, 0 = start
+
+// Hour Register
+#define DS1302_AM_PM DS1302_D5 // 0 = AM, 1 = PM
+#define DS1302_12_24 DS1302_D7 // 0 = 24 hour, 1 = 12 hour
+
+// Enable Register
+#define DS1302_WP DS1302_D7   // 1 = Write Protect, 0 = enabled
+
+// Trickle Register
+#define DS1302_ROUT0 DS1302_D0
+#define DS1302_ROUT1 DS1302_D1
+#define DS1302_DS0   DS1302_D2
+#define DS1302_DS1   DS1302_D3
+#define DS1302_TCS0  DS1302_D4
+#define DS1302_TCS1  DS1302_D5
+#define DS1302_TCS2  DS1302_D6
+#define DS1302_TCS3  DS1302_D7
+
+// Only this pattern of the TCS bits enables the charger.
+#define DS1302_TCS_ON (bit(DS1302_TCS3) | bit(DS1302_TCS1))
+
+// One bus session for the background engine.
+// The memory of the transaction and its data belongs to
+// the caller, and must stay valid until 'done' is set,
+// which is after the callback.
+struct DS1302Transaction
+ { uint8_t command;        // address or burst command, with read bit
+   uint8_t *data;
+   uint8_t length;         // number of data bytes
+   void (*callback)(DS1302Transaction &t);   // may be 0
+
+   volatile bool done;
+
+   // used by the engine
+   DS1302Bus *bus;
+   uint8_t pos;
+   DS1302Transaction *next;
+ };
+
+// Counters of DS1302RTC_STATS.
+// The bus time is the time of the delays of the timing profile,
+// see DS1302_COST_NS().
+struct DS1302Stats
+ { uint32_t sessions;
+   uint32_t bytes;          // command and data bytes
+   uint32_t busyMicros;
+   uint32_t retries;        // clock reads that were not valid
+   uint32_t cacheHits;
+   uint32_t cacheMisses;
+ };
+
+#ifdef DS1302RTC_STATS
+#define DS1302_STAT(x)  (x)
+#else
+#define DS1302_STAT(x)
+#endif
 
 // library interface description
+//
+// Every DS1302RTC object is one chip, several chips can
+// share the SCLK and I/O lines with their own CE line.
+// The static get() is the time of the first object that
+// was created, for setSyncProvider(RTC.get).
 class DS1302RTC
  { // user-accessible "public" interface
    public:
+#ifdef ARDUINO
       DS1302RTC(uint8_t io, uint8_t sclk, uint8_t rst);
+#endif
+      DS1302RTC(DS1302Bus &bus);
+      bool begin();
+      void end();
+
       static time_t get();
-      static bool set(time_t t);
-      static bool read(tmElements_t &tm);
-      static bool write(tmElements_t &tm);
+      time_t now();
+      bool set(time_t t);
+      time_t getEpoch();
+      bool read(tmElements_t &tm);
+      bool write(tmElements_t &tm);
+
+      // Set a part of the time.
+      bool setSeconds(uint8_t second);
+      bool setHMS(uint8_t hour, uint8_t minute, uint8_t second);
+      bool adjust(int32_t seconds);
    
-      static void halt();
-      static bool chipPresent() { return exists; }
+      void halt();
+
+      // Trickle charger: 1 or 2 diodes, a resistor of 2, 4 or 8 kOhm.
+      // 0 diodes turns it off. The setting is remembered,
+      // it is only written when it changes.
+      bool setTrickleCharger(uint8_t diodes, uint8_t resistor);
+      bool getTrickleCharger(uint8_t &diodes, uint8_t &resistor);
+      void setWriteProtect(bool on);
+      bool chipPresent() { return exists; }
+
+      // The 31 bytes of battery-backed ram.
+      bool readRAM(uint8_t *p, uint8_t offset, uint8_t length);
+      bool writeRAM(const uint8_t *p, uint8_t offset, uint8_t length);
+
+      // Cached mode for now() and get().
+      // The chip is read once and now() counts on with millis(),
+      // until 'resync' milliseconds have passed. 0 turns it off.
+      void setCache(uint32_t resync);
+      // After a sleep that stops millis(), the cache is wrong.
+      void invalidateCache() { cacheValid = false; }
+      // Milliseconds from now until 't', from the cache if possible,
+      // rounded down, so a sleep of that long doesn't pass 't'.
+      uint32_t millisUntil(time_t t);
+
+      // Drift correction against a reference time (NTP, GPS).
+      // syncTo() estimates the drift in ppb (+ is fast), now()
+      // and get() are corrected with it. The chip itself is only
+      // set when its error reaches the threshold in seconds.
+      bool syncTo(time_t reference);
+      int32_t drift() const { return driftPpb; }
+      void setDriftThreshold(uint16_t seconds) { driftThreshold = seconds; }
+
+      // Release the pins after every session, see DS1302Bus::end().
+      void setLowPower(bool on) { lowPower = on; }
+
+      // Start the cache at a second boundary, found by polling
+      // the seconds register, with a micros() anchor.
+      // That busy-polls the chip for up to 'timeout' milliseconds.
+      // getMillisEpoch() is the time in milliseconds since 1970,
+      // it syncs again when the cache runs out, so that call can
+      // block for up to 1.1 seconds. Without the cache the anchor
+      // is kept until the next syncToSecondEdge(). Without a
+      // valid clock (no chip) the sync fails fast, without the wait.
+      bool syncToSecondEdge(uint16_t timeout = 1100);
+      uint64_t getMillisEpoch();
+
+      // Non-blocking clock read, one byte per poll().
+      // The read owns the bus of all objects until it is done.
+      bool beginRead();
+      bool poll();
+      bool result(tmElements_t &tm);
+
+      // Background engine, driven by a timer interrupt.
+      // It serves the transactions of all objects in turn.
+      // While it runs, all other functions go through its queue.
+      static void beginEngine();
+      static void endEngine();
+      void enqueue(DS1302Transaction &t);
+      static void service();
+
+#ifdef DS1302RTC_THREADSAFE
+      // The time of the last now(), and the millis() of it.
+      // It doesn't wait for the bus, so it can be used by any
+      // task or interrupt, returns 0 if there is none.
+      time_t lastTime(uint32_t *at = 0) const;
+      bool lastTime(tmElements_t &tm) const;
+#endif
+
+#ifdef DS1302RTC_STATS
+      const DS1302Stats &stats() const { return statistics; }
+      void clearStats();
+#endif
+
+      // Convert the 8 bytes of a clock burst read.
+      // valid() checks the range of every field.
+      static bool valid(const uint8_t *regs);
+      static void decode(const uint8_t *regs, tmElements_t &tm);
+      static time_t epoch(const uint8_t *regs);
 
    private:
-      static void clock_burst_read(uint8_t *p);
-      static void clock_burst_write(uint8_t *p);
-      static uint8_t read(int address);
-      static void write(int address, uint8_t data);
-      static void start(void);
-      static void stop(void);
-      static uint8_t toggleread(void);
-      static void togglewrite( uint8_t data, uint8_t release);
+      friend class DS1302Batch;
+      friend class DS1302Scheduler;
+
+      void init();
+      void clock_burst_read(uint8_t *p);
+      bool readClock(uint8_t *p);
+      bool probe();
+      time_t correct(time_t t);
+      void clock_burst_write(uint8_t *p);
+      uint8_t read(int address);
+      void write(int address, uint8_t data);
+      void transfer(uint8_t command, uint8_t *p, uint8_t length);
+      void unprotect();
+      void writeClock(uint8_t *p);
+      bool update(const uint8_t *old, uint8_t *regs, uint8_t mask);
    
    private:
-      static bool exists;
+      // States of the non-blocking read
+      enum
+       { DS1302_ASYNC_IDLE,
+         DS1302_ASYNC_COMMAND,
+         DS1302_ASYNC_DATA,
+         DS1302_ASYNC_DONE = DS1302_ASYNC_DATA + 8
+       };
+
+      // Known state of the Write Protect bit
+      enum
+       { DS1302_WP_UNKNOWN,
+         DS1302_WP_CLEAR,
+         DS1302_WP_SET
+       };
+
+      static DS1302RTC *primary;
+
+      bool exists;
       
-      static uint8_t io;
-      static uint8_t sclk;
-      static uint8_t rst;
+#ifdef ARDUINO
+      DS1302PinBus pins;
+#endif
+      DS1302Bus *bus;
+
+      uint32_t cacheResync;
+      bool cacheValid;
+      bool cacheVerified;
+      time_t cacheTime;
+      uint32_t cacheMillis;
+      bool cacheEdge;         // the anchor is a second boundary
+      uint32_t edgeMicros;
+
+      uint8_t asyncState;
+      uint8_t asyncBuf[8];
+
+      bool lowPower;
+
+      time_t driftRef;        // reference of the anchor, 0 = none
+      int32_t driftError;     // chip - reference at the anchor
+      int32_t driftPpb;
+      uint16_t driftThreshold;
+
+      uint8_t wp;
+      bool protect;
+      uint8_t trickle;
+      bool trickleKnown;
+
+#ifdef DS1302RTC_THREADSAFE
+      void publish(time_t t, uint32_t ms);
+
+      // One for all chips, since they can share the lines.
+      static DS1302Mutex mutex;
+
+      // Two copies, the one of snapSeq & 1 is valid,
+      // the other one is written.
+      struct Snapshot
+       { time_t time;
+         uint32_t millis;
+       };
+      volatile Snapshot snap[2];
+      volatile uint32_t snapSeq;
+      volatile uint32_t snapBegin;
+#endif
+
+#ifdef DS1302RTC_STATS
+      void count(uint8_t length);
+
+      DS1302Stats statistics;
+      uint16_t busyNs;        // rest of busyMicros
+#endif
+
+      static volatile bool engineRunning;
+      static DS1302RTC * volatile asyncOwner;   // of the bus, see beginRead()
+      static DS1302Transaction * volatile queueHead;
+      static DS1302Transaction *queueTail;
  };
 
 #endif
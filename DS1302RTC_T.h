@@ -0,0 +1,154 @@
+/*
+ * DS1302RTC_T.h - DS1302 RTC with the pins given at compile time
+ *
+ * Usage:
+ *    DS1302RTC_T<5, 6, 7> RTC;   // io, sclk, rst
+ *
+ * The time functions are the same as for DS1302RTC.
+ * Because the pins are constants, the bit-bang primitives
+ * compile to single sbi/cbi/sbis instructions on the boards
+ * for which the pin to port mapping is known here.
+ * On other boards the runtime DS1302PinBus is used.
+ */
+
+#ifndef DS1302RTC_T_h
+#define DS1302RTC_T_h
+
+#include <Arduino.h>
+#include "DS1302RTC.h"
+
+// Pin to port mapping of the ATmega8/168/328 boards
+// (Uno, Nano, Pro Mini):
+//   pin 0-7 = PORTD, pin 8-13 = PORTB, pin 14-19 = PORTC.
+// The PINx, DDRx and PORTx registers of a port are consecutive.
+#if defined(DS1302RTC_FASTIO) && \
+    (defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || \
+     defined(__AVR_ATmega168P__) || defined(__AVR_ATmega168__) || \
+     defined(__AVR_ATmega8__))
+#define DS1302RTC_CONST_PINS
+
+template <uint8_t PIN>
+struct DS1302ConstPin
+ { enum
+    { port = PIN < 8 ? 0x2B : PIN < 14 ? 0x25 : 0x28,
+      ddr  = port - 1,
+      pin  = port - 2,
+      mask = 1 << (PIN < 8 ? PIN : PIN < 14 ? PIN - 8 : PIN - 14)
+    };
+
+   static void write(uint8_t value)
+    { if (value)
+         _SFR_MEM8(port) |= (uint8_t) mask;
+      else
+         _SFR_MEM8(port) &= (uint8_t) ~mask;
+    }
+   static uint8_t read() { return (_SFR_MEM8(pin) & mask) ? HIGH : LOW; }
+   static void output() { _SFR_MEM8(ddr) |= (uint8_t) mask; }
+   static bool isOutput() { return (_SFR_MEM8(ddr) & mask) != 0; }
+   static void input()
+    { _SFR_MEM8(ddr) &= (uint8_t) ~mask;
+      _SFR_MEM8(port) &= (uint8_t) ~mask;   // remove the pull-up
+    }
+ };
+
+// The same sequences as DS1302PinBus, see DS1302PinBus.cpp
+// for the timing comments.
+// The pins are set up once, like DS1302PinBus does. The
+// direction is read back from the DDR register, which is
+// shared with the other objects on the same SCLK and I/O-line.
+template <uint8_t IO, uint8_t SCLK, uint8_t RST>
+class DS1302ConstBus : public DS1302Bus
+ { public:
+      void begin(void)
+       { Rst::write(LOW);
+         Rst::output();
+         Sclk::write(LOW);
+         Sclk::output();
+         Io::output();
+       }
+
+      void start(void)
+       { if (!Rst::isOutput() || !Sclk::isOutput())
+            begin();
+
+         Rst::write(HIGH);
+         DS1302_DELAY_TCC();       // tCC
+       }
+
+      void end(void)
+       { Sclk::input();
+         Io::input();
+       }
+
+      void stop(void)
+       { Rst::write(LOW);
+         DS1302_DELAY_TCWH();      // tCWH
+       }
+
+      uint8_t toggleread(void)
+       { uint8_t i, data;
+
+         data = 0;
+         for (i = 0; i <= 7; i++)
+          { Sclk::write(HIGH);
+            DS1302_DELAY_TCH();
+            Sclk::write(LOW);
+            DS1302_DELAY_TCL();      // tCL, tCDD
+            if (Io::read())
+               data |= bit(i);
+          }
+         return (data);
+       }
+
+      void togglewrite(uint8_t data, uint8_t release)
+       { uint8_t i;
+
+         // The I/O-line is an input after a read.
+         if (!Io::isOutput())
+            Io::output();
+
+         for (i = 0; i <= 7; i++)
+          { Io::write(bitRead(data, i));
+            DS1302_DELAY_TDC();      // tDC
+            Sclk::write(HIGH);
+            DS1302_DELAY_TCH();      // tCH, tCDH
+
+            if (release && i == 7)
+               Io::input();
+            else
+             { Sclk::write(LOW);
+               DS1302_DELAY_TCL();   // tCL, tCDD
+             }
+          }
+       }
+
+   private:
+      typedef DS1302ConstPin<IO> Io;
+      typedef DS1302ConstPin<SCLK> Sclk;
+      typedef DS1302ConstPin<RST> Rst;
+ };
+
+#else
+
+// Unknown pin mapping: resolve the pins at runtime.
+template <uint8_t IO, uint8_t SCLK, uint8_t RST>
+class DS1302ConstBus : public DS1302PinBus
+ { public:
+      DS1302ConstBus() { setPins(IO, SCLK, RST); }
+ };
+
+#endif
+
+
+template <uint8_t IO, uint8_t SCLK, uint8_t RST>
+class DS1302RTC_T : public DS1302RTC
+ { public:
+      // The base class only keeps a pointer to the bus,
+      // so it can be given before the member is constructed.
+      DS1302RTC_T() : DS1302RTC(constPins) { }
+
+   private:
+      DS1302ConstBus<IO, SCLK, RST> constPins;
+ };
+
+#endif
@@ -0,0 +1,199 @@
+// DS1302 scheduler
+// ----------------
+//
+// The chip is read once, at the expected rollover to the
+// second of the first event. Until then run() doesn't use the bus.
+// The rollover comes from millisUntil(), which is exact with an
+// edge anchored cache (syncToSecondEdge()). Otherwise the cache
+// is only known within a second, and the chip is polled from the
+// earliest moment. Without the cache, the chip is read for the
+// time, and polled from a second before the event. The rollover
+// that is seen then is kept as an edge for the next events,
+// so they need a single read.
+// After the chip is read, every event up to that time is run,
+// without reading the chip again.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302Scheduler.h"
+
+DS1302Scheduler::DS1302Scheduler(DS1302RTC &rtc)
+ : chip(rtc), count(0), lastPoll(0), pollWait(0),
+   edgeKnown(false), early(false)
+ { }
+
+bool DS1302Scheduler::at(time_t t, DS1302Callback callback, uint32_t period)
+ { Event e;
+
+   if (count >= DS1302_SCHEDULER_MAX || callback == 0)
+      return false;
+
+   e.time = t;
+   e.period = period;
+   e.callback = callback;
+   push(e);
+   pollWait = 0;               // it may be the first one now
+   return true;
+ }
+
+void DS1302Scheduler::remove(DS1302Callback callback)
+ { uint8_t i, n;
+   Event keep[DS1302_SCHEDULER_MAX];
+
+   n = 0;
+   for (i = 0; i < count; i++)
+      if (events[i].callback != callback)
+         keep[n++] = events[i];
+
+   count = 0;
+   for (i = 0; i < n; i++)
+      push(keep[i]);
+ }
+
+uint32_t DS1302Scheduler::millisUntilNext()
+ { if (count == 0)
+      return 0xFFFFFFFFUL;
+   return chip.millisUntil(events[0].time);
+ }
+
+
+// --------------------------------------------------------
+// DS1302Scheduler::wait
+//
+// Milliseconds until the chip is expected to roll over to the
+// second of the first event. From the last seen edge if there
+// is one, else from the cache. At most a second, so a resync
+// of the cache is picked up. Without an edge or the cache it
+// is 0, run() reads the chip and waits from there.
+// millis() drifts from the chip, so an old edge is checked
+// a poll early, which finds the rollover again.
+//
+uint32_t DS1302Scheduler::wait()
+ { int32_t ms;
+
+   if (edgeKnown && events[0].time - edgeTime < 86400L)
+    { ms = (int32_t) (events[0].time - edgeTime) * 1000 -
+           (int32_t) (millis() - edge);
+      if (millis() - edge >= DS1302_SCHEDULER_EDGE_MS)
+         ms -= DS1302_SCHEDULER_POLL_MS;
+    }
+   else if (chip.cacheResync != 0)
+      ms = (int32_t) chip.millisUntil(events[0].time);
+   else
+      return 0;
+
+   if (ms <= 0)
+      return 0;
+   return ms < 1000 ? (uint32_t) ms : 1000;
+ }
+
+
+// --------------------------------------------------------
+// DS1302Scheduler::run
+//
+void DS1302Scheduler::run()
+ { time_t t;
+   Event e;
+
+   if (count == 0)
+      return;
+
+   if (millis() - lastPoll < pollWait)
+      return;
+   lastPoll = millis();
+
+   pollWait = wait();
+   if (pollWait > 0)
+      return;
+
+   { DS1302_LOCK(chip.mutex);
+
+      t = chip.getEpoch();
+      if (t == 0)
+       { pollWait = DS1302_SCHEDULER_POLL_MS;
+         return;               // no valid time
+       }
+      t = chip.correct(t);     // the same time base as now()
+   }
+
+   if (events[0].time > t)
+    { // Early. Just before the rollover poll for it, else
+      // wait until a second before it. Then the edge or the
+      // cache is wrong, so forget the edge.
+      early = events[0].time - t == 1;
+      if (early)
+         pollWait = DS1302_SCHEDULER_POLL_MS;
+      else
+       { edgeKnown = false;
+         if ((uint32_t) (events[0].time - t - 1) < DS1302_SCHEDULER_EDGE_MS / 1000)
+            pollWait = (uint32_t) (events[0].time - t - 1) * 1000;
+         else
+            pollWait = DS1302_SCHEDULER_EDGE_MS;
+       }
+      return;
+    }
+
+   // The rollover was between the last two reads,
+   // a poll apart.
+   if (early && events[0].time == t)
+    { edge = lastPoll;
+      edgeTime = t;
+      edgeKnown = true;
+    }
+   early = false;
+
+   while (count > 0 && events[0].time <= t)
+    { e = events[0];
+      pop();
+      if (e.period != 0)
+       { Event again = e;
+
+         // Skip the periods that were missed.
+         do
+            again.time += e.period;
+         while (again.time <= t);
+         push(again);
+       }
+      e.callback(e.time);
+    }
+ }
+
+
+// --------------------------------------------------------
+// DS1302Scheduler::push, pop
+//
+// The binary heap, events[0] is the first one due.
+//
+void DS1302Scheduler::push(const Event &e)
+ { uint8_t i, parent;
+
+   i = count++;
+   while (i > 0)
+    { parent = (i - 1) / 2;
+      if (events[parent].time <= e.time)
+         break;
+      events[i] = events[parent];
+      i = parent;
+    }
+   events[i] = e;
+ }
+
+void DS1302Scheduler::pop()
+ { uint8_t i, child;
+   Event last;
+
+   last = events[--count];
+   i = 0;
+   for (;;)
+    { child = 2 * i + 1;
+      if (child >= count)
+         break;
+      if (child + 1 < count && events[child + 1].time < events[child].time)
+         child++;
+      if (last.time <= events[child].time)
+         break;
+      events[i] = events[child];
+      i = child;
+    }
+   events[i] = last;
+ }
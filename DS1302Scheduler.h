@@ -0,0 +1,81 @@
+/*
+ * DS1302Scheduler.h - timed callbacks without polling the chip
+ *
+ * Usage:
+ *    DS1302Scheduler scheduler(RTC);
+ *    scheduler.at(t, alarm);            // once
+ *    scheduler.at(t, tick, 60);         // every minute from t
+ *    ...
+ *    loop() { scheduler.run(); }
+ *
+ * run() waits for the expected rollover to the second of an
+ * event, from the cache of now() (see setCache()) or from the
+ * last rollover it saw. Only then the chip is read to confirm it.
+ * Without the cache, it reads the chip for that, polling no
+ * faster than DS1302_SCHEDULER_POLL_MS.
+ * So the bus is used about once per event, not on every run().
+ * The events are in a small min-heap, the first one due on top.
+ */
+
+#ifndef DS1302Scheduler_h
+#define DS1302Scheduler_h
+
+#include "DS1302RTC.h"
+
+#ifndef DS1302_SCHEDULER_MAX
+#define DS1302_SCHEDULER_MAX 8
+#endif
+
+// Time between two reads of the chip, while an event
+// may be due according to the cached time but is not yet on the chip.
+#ifndef DS1302_SCHEDULER_POLL_MS
+#define DS1302_SCHEDULER_POLL_MS 50
+#endif
+
+// How long a rollover that was seen is trusted as it is.
+// After that it is checked a poll early.
+#ifndef DS1302_SCHEDULER_EDGE_MS
+#define DS1302_SCHEDULER_EDGE_MS 60000UL
+#endif
+
+typedef void (*DS1302Callback)(time_t t);
+
+class DS1302Scheduler
+ { public:
+      DS1302Scheduler(DS1302RTC &rtc);
+
+      // Returns false if the scheduler is full.
+      bool at(time_t t, DS1302Callback callback, uint32_t period = 0);
+      // Remove all events with this callback.
+      void remove(DS1302Callback callback);
+
+      void run();
+
+      uint8_t pending() const { return count; }
+      time_t next() const { return count > 0 ? events[0].time : 0; }
+      // For a sleep until the next event.
+      uint32_t millisUntilNext();
+
+   private:
+      struct Event
+       { time_t time;
+         uint32_t period;
+         DS1302Callback callback;
+       };
+
+      uint32_t wait();
+      void push(const Event &e);
+      void pop();
+
+      DS1302RTC &chip;
+      Event events[DS1302_SCHEDULER_MAX];
+      uint8_t count;
+      uint32_t lastPoll;
+      uint32_t pollWait;      // from lastPoll until the next check
+      uint32_t edge;          // millis() just after a rollover
+      time_t edgeTime;        // the second that started there
+      bool edgeKnown;
+      bool early;             // the last read was before the event
+ };
+
+#endif
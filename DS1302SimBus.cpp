@@ -0,0 +1,201 @@
+// DS1302 simulator
+// ----------------
+//
+// The session is followed byte by byte.
+// The command byte selects a register, or a burst of the
+// clock or the ram. Writes are ignored while the Write
+// Protect is set, except to the Enable register itself.
+// A clock burst write is only taken over when all 8 bytes
+// are written, as the datasheet requires.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302SimBus.h"
+
+#define bcd2bin_sim(b)   (((b) >> 4) * 10 + ((b) & 0x0F))
+#define bin2bcd_sim(x)   ((((x) / 10) << 4) | ((x) % 10))
+
+static const uint8_t daysInMonth[12] =
+ { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+DS1302SimBus::DS1302SimBus()
+ { reset();
+   clearCounters();
+ }
+
+void DS1302SimBus::reset()
+ { memset(clock, 0, sizeof(clock));
+   clock[0] = bit(DS1302_CH);        // 00 seconds, halted
+   clock[3] = 0x01;                  // date
+   clock[4] = 0x01;                  // month
+   clock[5] = 0x07;                  // day, a saturday
+   clock[7] = bit(DS1302_WP);
+   trickle = 0x5C;                   // the charger is off
+   memset(ram, 0, sizeof(ram));
+   state = DS1302_SIM_IDLE;
+ }
+
+void DS1302SimBus::clearCounters()
+ { memset(&counters, 0, sizeof(counters));
+ }
+
+
+// --------------------------------------------------------
+// DS1302SimBus::tick
+//
+// Count on one second, in the format of the hour register.
+//
+void DS1302SimBus::tick()
+ { uint8_t second, minute, hour, date, month, year, days;
+   bool h12, pm;
+
+   if (bitRead(clock[0], DS1302_CH))
+      return;
+
+   second = bcd2bin_sim(clock[0] & 0x7F) + 1;
+   minute = bcd2bin_sim(clock[1]);
+   h12 = bitRead(clock[2], DS1302_12_24);
+   if (h12)
+    { pm = bitRead(clock[2], DS1302_AM_PM);
+      hour = bcd2bin_sim(clock[2] & 0x1F) % 12 + (pm ? 12 : 0);
+    }
+   else
+      hour = bcd2bin_sim(clock[2] & 0x3F);
+   date = bcd2bin_sim(clock[3]);
+   month = bcd2bin_sim(clock[4]);
+   year = bcd2bin_sim(clock[6]);
+
+   if (second == 60)
+    { second = 0;
+      if (++minute == 60)
+       { minute = 0;
+         if (++hour == 24)
+          { hour = 0;
+            clock[5] = clock[5] % 7 + 1;
+            days = daysInMonth[month - 1] + (month == 2 && (year & 3) == 0);
+            if (++date > days)
+             { date = 1;
+               if (++month > 12)
+                { month = 1;
+                  year = (year + 1) % 100;
+                }
+             }
+          }
+       }
+    }
+
+   clock[0] = bin2bcd_sim(second);
+   clock[1] = bin2bcd_sim(minute);
+   if (h12)
+    { pm = hour >= 12;
+      hour %= 12;
+      clock[2] = bit(DS1302_12_24) | (pm ? bit(DS1302_AM_PM) : 0) |
+                 bin2bcd_sim(hour == 0 ? 12 : hour);
+    }
+   else
+      clock[2] = bin2bcd_sim(hour);
+   clock[3] = bin2bcd_sim(date);
+   clock[4] = bin2bcd_sim(month);
+   clock[6] = bin2bcd_sim(year);
+ }
+
+
+// --------------------------------------------------------
+// DS1302SimBus::start, stop
+//
+void DS1302SimBus::start(void)
+ { state = DS1302_SIM_COMMAND;
+   pos = 0;
+   counters.sessions++;
+   counters.busyNs += DS1302_SESSION_NS;
+ }
+
+void DS1302SimBus::stop(void)
+ { // A clock burst write is done at the end.
+   if (state == DS1302_SIM_WRITE && command == DS1302_CLOCK_BURST_WRITE &&
+       pos >= 8 && !bitRead(clock[7], DS1302_WP))
+      memcpy(clock, buffer, 8);
+
+   state = DS1302_SIM_IDLE;
+ }
+
+
+// --------------------------------------------------------
+// DS1302SimBus::target
+//
+// The register of byte 'n' of the session, or 0.
+//
+uint8_t *DS1302SimBus::target(uint8_t n)
+ { uint8_t address = (command >> 1) & 0x1F;
+   bool isRam = bitRead(command, DS1302_RC);
+
+   if (address == 0x1F)       // burst
+    { if (isRam)
+         return n < DS1302_RAMSIZE ? &ram[n] : 0;
+      return n < 8 ? &buffer[n] : 0;
+    }
+
+   if (n > 0)
+      return 0;
+   if (isRam)
+      return address < DS1302_RAMSIZE ? &ram[address] : 0;
+   if (address < 8)
+      return &clock[address];
+   if (address == 8)
+      return &trickle;
+   return 0;
+ }
+
+
+uint8_t DS1302SimBus::toggleread(void)
+ { uint8_t *p;
+
+   counters.bytes++;
+   counters.edges += 16;
+   counters.busyNs += DS1302_BYTE_NS;
+
+   if (state != DS1302_SIM_READ)
+      return 0x00;               // the pull-down
+   p = target(pos++);
+   return p != 0 ? *p : 0x00;
+ }
+
+
+void DS1302SimBus::togglewrite(uint8_t data, uint8_t)
+ { uint8_t *p;
+
+   counters.bytes++;
+   counters.edges += 16;
+   counters.busyNs += DS1302_BYTE_NS;
+
+   if (state == DS1302_SIM_COMMAND)
+    { command = data;
+      if (!bitRead(command, DS1302_D7))
+         state = DS1302_SIM_IGNORE;
+      else if (bitRead(command, DS1302_READBIT))
+       { state = DS1302_SIM_READ;
+         memcpy(buffer, clock, 8);
+       }
+      else
+         state = DS1302_SIM_WRITE;
+      return;
+    }
+
+   if (state != DS1302_SIM_WRITE)
+      return;
+
+   // The clock burst is written to the copy, until stop().
+   if (command == DS1302_CLOCK_BURST_WRITE)
+    { if (pos < 8)
+         buffer[pos] = data;
+      pos++;
+      return;
+    }
+
+   p = target(pos++);
+   if (p == 0)
+      return;
+   if (bitRead(clock[7], DS1302_WP) && p != &clock[7])
+      return;
+   *p = data;
+ }
@@ -0,0 +1,72 @@
+/*
+ * DS1302SimBus.h - a simulated DS1302 behind the bus interface
+ *
+ * Usage, on the host or on a board without a chip:
+ *    DS1302SimBus sim;
+ *    DS1302RTC RTC(sim);
+ *    RTC.set(t);
+ *    sim.tick();            // one second later
+ *
+ * The simulator has the clock registers, the Enable and
+ * Trickle registers and the ram, with the burst commands,
+ * the Write Protect, the Clock Halt and the 12/24 hour format.
+ * A burst read returns a copy of the clock taken at the
+ * start, like the chip does.
+ * The counters give the bus cost of the calls: sessions,
+ * bytes, SCLK edges and the bus time of the timing profile.
+ * extras/test builds the library with it on the host:
+ *    make -C extras/test
+ */
+
+#ifndef DS1302SimBus_h
+#define DS1302SimBus_h
+
+#include "DS1302RTC.h"
+
+class DS1302SimBus : public DS1302Bus
+ { public:
+      DS1302SimBus();
+
+      void start(void);
+      void stop(void);
+      uint8_t toggleread(void);
+      void togglewrite(uint8_t data, uint8_t release);
+
+      // The state at power up: 2000-01-01 00:00:00, halted.
+      void reset();
+      // One second passes, unless the clock is halted.
+      void tick();
+
+      // The registers, as the chip has them.
+      uint8_t clock[8];        // the 7 clock registers and Enable
+      uint8_t trickle;
+      uint8_t ram[DS1302_RAMSIZE];
+
+      // Cost counters, cleared by clearCounters().
+      struct Counters
+       { uint32_t sessions;
+         uint32_t bytes;
+         uint32_t edges;       // rising and falling SCLK edges
+         uint32_t busyNs;      // see DS1302_COST_NS()
+       } counters;
+      void clearCounters();
+
+   private:
+      // States of a session
+      enum
+       { DS1302_SIM_IDLE,
+         DS1302_SIM_COMMAND,
+         DS1302_SIM_READ,
+         DS1302_SIM_WRITE,
+         DS1302_SIM_IGNORE
+       };
+
+      uint8_t *target(uint8_t pos);
+
+      uint8_t state;
+      uint8_t command;
+      uint8_t pos;
+      uint8_t buffer[8];       // burst copy of the clock
+ };
+
+#endif
@@ -0,0 +1,65 @@
+// DS1302 SPI bus
+// --------------
+//
+// The SPI transaction is started before CE is raised,
+// so SCLK is low (mode 0) at the start of the session.
+// The release of the I/O-line is not needed, the resistor
+// takes care of that.
+// A read of several bytes is a single buffer transfer,
+// which uses DMA on the cores that support it.
+//
+
+#include <Arduino.h>
+#include "DS1302SpiBus.h"
+
+DS1302SpiBus::DS1302SpiBus(uint8_t ce, SPIClass &spi)
+ : cePin(ce), port(spi), configured(false)
+ { }
+
+void DS1302SpiBus::begin(void)
+ { digitalWrite(cePin, LOW);   // not enabled
+   pinMode(cePin, OUTPUT);
+   port.begin();
+   configured = true;
+ }
+
+void DS1302SpiBus::start(void)
+ { if (!configured)
+      begin();
+
+   port.beginTransaction(SPISettings(DS1302_SPI_CLOCK, LSBFIRST, SPI_MODE0));
+   digitalWrite(cePin, HIGH);
+   DS1302_DELAY_TCC();         // tCC
+ }
+
+void DS1302SpiBus::stop(void)
+ { digitalWrite(cePin, LOW);
+   port.endTransaction();
+   DS1302_DELAY_TCWH();        // tCWH
+ }
+
+uint8_t DS1302SpiBus::toggleread(void)
+ { return port.transfer(0x00);
+ }
+
+void DS1302SpiBus::togglewrite(uint8_t data, uint8_t)
+ { port.transfer(data);
+ }
+
+void DS1302SpiBus::transfer(uint8_t command, uint8_t *p, uint8_t length)
+ { uint8_t i;
+
+   start();
+   port.transfer(command);
+   if (bitRead(command, DS1302_READBIT))
+    { // The received bytes replace the zeros that are sent.
+      memset(p, 0, length);
+      port.transfer(p, length);
+    }
+   else
+    { // Not in place, that would overwrite the data.
+      for (i = 0; i < length; i++)
+         port.transfer(p[i]);
+    }
+   stop();
+ }
@@ -0,0 +1,51 @@
+/*
+ * DS1302SpiBus.h - the 3-wire bus on the SPI hardware
+ *
+ * Wiring:
+ *    SCK  -> SCLK
+ *    MISO -> I/O
+ *    MOSI -> 1k to 10k resistor -> I/O
+ *    any pin -> CE
+ * During a read the DS1302 drives the I/O-line,
+ * the resistor keeps MOSI from fighting it.
+ *
+ * Usage:
+ *    DS1302SpiBus spiBus(10);   // CE pin
+ *    DS1302RTC RTC(spiBus);
+ *
+ * The DS1302 is LSB first and takes the data at the
+ * rising edge of SCLK, that is SPI mode 0.
+ * The clock is the fastest the timing profile allows,
+ * see DS1302Timing.h, or set DS1302_SPI_CLOCK.
+ */
+
+#ifndef DS1302SpiBus_h
+#define DS1302SpiBus_h
+
+#include <SPI.h>
+#include "DS1302RTC.h"
+
+#ifndef DS1302_SPI_CLOCK
+#define DS1302_SPI_CLOCK \
+   (1000000000UL / (DS1302_MAX_NS(DS1302_TCH_NS, DS1302_TCDH_NS) + \
+                    DS1302_MAX_NS(DS1302_TCL_NS, DS1302_TCDD_NS)))
+#endif
+
+class DS1302SpiBus : public DS1302Bus
+ { public:
+      DS1302SpiBus(uint8_t ce, SPIClass &spi = SPI);
+
+      void begin(void);
+      void start(void);
+      void stop(void);
+      uint8_t toggleread(void);
+      void togglewrite(uint8_t data, uint8_t release);
+      void transfer(uint8_t command, uint8_t *p, uint8_t length);
+
+   private:
+      uint8_t cePin;
+      SPIClass &port;
+      bool configured;
+ };
+
+#endif
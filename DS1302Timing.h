@@ -0,0 +1,93 @@
+/*
+ * DS1302Timing.h - bus timing of the DS1302 RTC library
+ *
+ * The delays of the bit-bang code are the minimum values of the
+ * datasheet (AC Electrical Characteristics).
+ * Those depend on the supply voltage, so a profile is selected
+ * with DS1302RTC_VCC:
+ *    2 : Vcc = 2.0V, valid over the whole supply range (default)
+ *    5 : Vcc = 5.0V, SCLK up to 2MHz
+ * Every value can also be set on its own in nanoseconds,
+ * for example with -DDS1302_TCH_NS=500.
+ */
+
+#ifndef DS1302Timing_h
+#define DS1302Timing_h
+
+#ifndef DS1302RTC_VCC
+#define DS1302RTC_VCC 2
+#endif
+
+#if DS1302RTC_VCC >= 5
+#define DS1302_PROFILE_TDC_NS    50     // data to clock setup
+#define DS1302_PROFILE_TCDH_NS   70     // clock to data hold
+#define DS1302_PROFILE_TCDD_NS   200    // clock to data delay
+#define DS1302_PROFILE_TCL_NS    250    // clock low time
+#define DS1302_PROFILE_TCH_NS    250    // clock high time
+#define DS1302_PROFILE_TCC_NS    1000   // CE to clock setup
+#define DS1302_PROFILE_TCWH_NS   1000   // CE inactive time
+#else
+#define DS1302_PROFILE_TDC_NS    200
+#define DS1302_PROFILE_TCDH_NS   280
+#define DS1302_PROFILE_TCDD_NS   800
+#define DS1302_PROFILE_TCL_NS    1000
+#define DS1302_PROFILE_TCH_NS    1000
+#define DS1302_PROFILE_TCC_NS    4000
+#define DS1302_PROFILE_TCWH_NS   4000
+#endif
+
+#ifndef DS1302_TDC_NS
+#define DS1302_TDC_NS   DS1302_PROFILE_TDC_NS
+#endif
+#ifndef DS1302_TCDH_NS
+#define DS1302_TCDH_NS  DS1302_PROFILE_TCDH_NS
+#endif
+#ifndef DS1302_TCDD_NS
+#define DS1302_TCDD_NS  DS1302_PROFILE_TCDD_NS
+#endif
+#ifndef DS1302_TCL_NS
+#define DS1302_TCL_NS   DS1302_PROFILE_TCL_NS
+#endif
+#ifndef DS1302_TCH_NS
+#define DS1302_TCH_NS   DS1302_PROFILE_TCH_NS
+#endif
+#ifndef DS1302_TCC_NS
+#define DS1302_TCC_NS   DS1302_PROFILE_TCC_NS
+#endif
+#ifndef DS1302_TCWH_NS
+#define DS1302_TCWH_NS  DS1302_PROFILE_TCWH_NS
+#endif
+
+#define DS1302_MAX_NS(a,b)  ((a) > (b) ? (a) : (b))
+
+// Busy-wait for at least 'ns' nanoseconds.
+// On AVR the number of cycles is calculated at compile time
+// from F_CPU, other targets round up to whole microseconds.
+#if defined(__AVR__) && defined(F_CPU)
+#define DS1302_NS_TO_CYCLES(ns) \
+   ((((unsigned long) (ns)) * (F_CPU / 1000000UL) + 999UL) / 1000UL)
+#define DS1302_DELAY_NS(ns)  __builtin_avr_delay_cycles(DS1302_NS_TO_CYCLES(ns))
+#else
+#define DS1302_DELAY_NS(ns)  delayMicroseconds(((ns) + 999) / 1000)
+#endif
+
+// The delays as used by the bit-bang code.
+// A high clock also covers the data hold time,
+// a low clock also covers the output delay of the DS1302.
+#define DS1302_DELAY_TDC()   DS1302_DELAY_NS(DS1302_TDC_NS)
+#define DS1302_DELAY_TCH()   DS1302_DELAY_NS(DS1302_MAX_NS(DS1302_TCH_NS, DS1302_TCDH_NS))
+#define DS1302_DELAY_TCL()   DS1302_DELAY_NS(DS1302_MAX_NS(DS1302_TCL_NS, DS1302_TCDD_NS))
+#define DS1302_DELAY_TCC()   DS1302_DELAY_NS(DS1302_TCC_NS)
+#define DS1302_DELAY_TCWH()  DS1302_DELAY_NS(DS1302_TCWH_NS)
+
+// Estimated bus time of one byte and of the CE overhead of
+// one session, to choose between burst and single accesses.
+#define DS1302_BYTE_NS    (8UL * (DS1302_TDC_NS + \
+                           DS1302_MAX_NS(DS1302_TCH_NS, DS1302_TCDH_NS) + \
+                           DS1302_MAX_NS(DS1302_TCL_NS, DS1302_TCDD_NS)))
+#define DS1302_SESSION_NS ((unsigned long) DS1302_TCC_NS + DS1302_TCWH_NS)
+#define DS1302_COST_NS(bytes, sessions) \
+   ((unsigned long) (bytes) * DS1302_BYTE_NS + \
+    (unsigned long) (sessions) * DS1302_SESSION_NS)
+
+#endif
@@ -0,0 +1,207 @@
+// DS1302 benchmark
+// ----------------
+//
+// Measure the cycles of every bus function, for each bus.
+// The cycles are counted with Timer1 on AVR,
+// with the DWT cycle counter on ARM Cortex-M3 and up,
+// and with micros() on the other boards.
+//
+// The timing profile is selected at compile time,
+// build again with -DDS1302RTC_VCC=5 to compare them.
+// Set the pins below, and SPI_CE to also measure the SPI bus
+// (with a resistor between MOSI and MISO).
+//
+// Note: the write tests write the clock and RAM byte 0 of the
+// chip, and halt the clock. Both are saved before and restored
+// after each bus, the time is set again with the seconds that
+// passed. Without a valid time on the chip, the clock write
+// tests are skipped, so the chip is not set to a zeroed date.
+//
+
+#include <Time.h>
+#include <SPI.h>
+#include <DS1302RTC.h>
+#include <DS1302RTC_T.h>
+#include <DS1302SpiBus.h>
+
+#define PIN_IO    5
+#define PIN_SCLK  6
+#define PIN_CE    7
+// #define SPI_CE 10
+
+#define RUNS 16
+
+// The buses are objects of their own,
+// so the raw transfer() can be measured too.
+DS1302PinBus pinBus;
+DS1302RTC pinRTC(pinBus);
+DS1302ConstBus<PIN_IO, PIN_SCLK, PIN_CE> constBus;
+DS1302RTC constRTC(constBus);
+#ifdef SPI_CE
+DS1302SpiBus spiBus(SPI_CE);
+DS1302RTC spiRTC(spiBus);
+#endif
+
+
+// --------------------------------------------------------
+// Cycle counter
+//
+#if defined(__AVR__)
+static volatile uint16_t overflows;
+
+ISR(TIMER1_OVF_vect)
+ { overflows++;
+ }
+
+void counterBegin()
+ { TCCR1A = 0;
+   TCCR1B = bit(CS10);          // no prescaler
+   TIMSK1 = bit(TOIE1);
+ }
+
+uint32_t cycles()
+ { uint8_t oldSREG = SREG;
+   uint16_t low, high;
+
+   cli();
+   low = TCNT1;
+   high = overflows;
+   if ((TIFR1 & bit(TOV1)) && low < 0x8000)
+      high++;                    // not yet counted
+   SREG = oldSREG;
+   return ((uint32_t) high << 16) | low;
+ }
+#define COUNTER "Timer1"
+
+#elif defined(DWT) && defined(CoreDebug_DEMCR_TRCENA_Msk)
+void counterBegin()
+ { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+   DWT->CYCCNT = 0;
+   DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+ }
+
+uint32_t cycles()
+ { return DWT->CYCCNT;
+ }
+#define COUNTER "DWT"
+
+#else
+void counterBegin()
+ { }
+
+uint32_t cycles()
+ { return micros() * (F_CPU / 1000000UL);
+ }
+#define COUNTER "micros"
+#endif
+
+
+// --------------------------------------------------------
+// The measured functions.
+// Each one is run RUNS times, the average is printed.
+//
+DS1302RTC *rtc;
+DS1302Bus *bus;
+uint8_t regs[8];
+uint8_t data;
+tmElements_t tm;
+
+void burstRead()   { bus->transfer(DS1302_CLOCK_BURST_READ, regs, 8); }
+void burstWrite()  { rtc->write(tm); }
+void singleRead()  { rtc->readRAM(&data, 0, 1); }
+void singleWrite() { rtc->writeRAM(&data, 0, 1); }
+void readTm()      { rtc->read(tm); }
+void getEpoch()    { rtc->getEpoch(); }
+void decodeOnly()  { DS1302RTC::decode(regs, tm); }
+void epochOnly()   { DS1302RTC::epoch(regs); }
+void setHalt()     { rtc->halt(); }
+
+struct Test
+ { const char *name;
+   void (*run)();
+   bool clock;                  // writes the clock
+ };
+
+const Test tests[] =
+ { { "clock burst read ", burstRead, false },
+   { "clock burst write", burstWrite, true },
+   { "single read      ", singleRead, false },
+   { "single write     ", singleWrite, false },
+   { "read(tm)         ", readTm, false },
+   { "getEpoch()       ", getEpoch, false },
+   { "decode           ", decodeOnly, false },
+   { "epoch            ", epochOnly, false },
+   { "halt()           ", setHalt, true },
+ };
+
+void measure(const char *busName, DS1302RTC &r, DS1302Bus &b)
+ { uint8_t i, n;
+   uint32_t start, total, savedMillis;
+   time_t saved;
+   uint8_t savedRAM;
+
+   rtc = &r;
+   bus = &b;
+   rtc->begin();
+
+   // Save what the write tests change.
+   // The write test writes the same time again.
+   saved = rtc->getEpoch();
+   savedMillis = millis();
+   rtc->readRAM(&savedRAM, 0, 1);
+   data = savedRAM;
+   if (saved != 0)
+      breakTime(saved, tm);
+
+   Serial.print(busName);
+   Serial.println(rtc->chipPresent() ? "" : " (no chip)");
+   for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    { if (tests[i].clock && saved == 0)
+       { Serial.print("  ");
+         Serial.print(tests[i].name);
+         Serial.println(" skipped, no valid time");
+         continue;
+       }
+      total = 0;
+      for (n = 0; n < RUNS; n++)
+       { start = cycles();
+         tests[i].run();
+         total += cycles() - start;
+       }
+      Serial.print("  ");
+      Serial.print(tests[i].name);
+      Serial.print(" ");
+      Serial.print(total / RUNS);
+      Serial.print(" cycles, ");
+      Serial.print(total / RUNS / (F_CPU / 1000000UL));
+      Serial.println(" us");
+    }
+
+   // Restore the time, with the seconds the tests took.
+   rtc->writeRAM(&savedRAM, 0, 1);
+   if (saved != 0)
+      rtc->set(saved + (millis() - savedMillis + 500) / 1000);
+ }
+
+void setup()
+ { Serial.begin(9600);
+   counterBegin();
+
+   Serial.print("DS1302 benchmark, counter ");
+   Serial.print(COUNTER);
+   Serial.print(", profile ");
+   Serial.print(DS1302RTC_VCC);
+   Serial.print("V, F_CPU ");
+   Serial.println(F_CPU);
+
+   pinBus.setPins(PIN_IO, PIN_SCLK, PIN_CE);
+   measure("DS1302PinBus", pinRTC, pinBus);
+   measure("DS1302ConstBus", constRTC, constBus);
+
+#ifdef SPI_CE
+   measure("DS1302SpiBus", spiRTC, spiBus);
+#endif
+ }
+
+void loop()
+ { }
@@ -0,0 +1,53 @@
+// DS1302 host platform
+// --------------------
+//
+// The functions DS1302Platform.h asks for, on a simulated
+// time, see DS1302Host.h. There are no interrupts.
+//
+
+#include "DS1302Platform.h"
+#include "DS1302Host.h"
+
+static uint64_t hostMicros;
+static DS1302SimBus *hostSim;
+static uint32_t hostPhase;
+
+void hostAttach(DS1302SimBus *sim, uint32_t phase)
+ { hostSim = sim;
+   hostPhase = phase;
+ }
+
+// The number of second edges up to 'us'.
+static uint64_t edges(uint64_t us)
+ { return (us + 1000000 - hostPhase) / 1000000;
+ }
+
+void hostAdvance(uint32_t us)
+ { uint64_t n;
+
+   n = edges(hostMicros + us) - edges(hostMicros);
+   hostMicros += us;
+   if (hostSim != 0)
+      while (n-- > 0)
+         hostSim->tick();
+ }
+
+uint32_t millis(void)
+ { hostAdvance(1);
+   return (uint32_t) (hostMicros / 1000);
+ }
+
+uint32_t micros(void)
+ { hostAdvance(1);
+   return (uint32_t) hostMicros;
+ }
+
+void delayMicroseconds(unsigned int us)
+ { hostAdvance(us);
+ }
+
+void noInterrupts(void)
+ { }
+
+void interrupts(void)
+ { }
@@ -0,0 +1,19 @@
+/*
+ * DS1302Host.h - the simulated time of the host test
+ *
+ * The host time only moves with hostAdvance(), with
+ * delayMicroseconds(), and by a microsecond on every millis()
+ * or micros() call, so a busy loop ends. An attached simulator
+ * ticks once every simulated second, 'phase' microseconds
+ * into the second.
+ */
+
+#ifndef DS1302Host_h
+#define DS1302Host_h
+
+#include "DS1302SimBus.h"
+
+void hostAttach(DS1302SimBus *sim, uint32_t phase = 300000UL);
+void hostAdvance(uint32_t us);
+
+#endif
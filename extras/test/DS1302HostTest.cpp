@@ -0,0 +1,424 @@
+// DS1302 host test
+// ----------------
+//
+// The library against DS1302SimBus: time round trips,
+// the 12/24 hour format, Write Protect and the ram bursts,
+// and the bus cost of the cache, the ram cache, the event log
+// and the batch. The time is simulated, see DS1302Host.h.
+// Returns 1 if a check fails.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "DS1302RTC.h"
+#include "DS1302SimBus.h"
+#include "DS1302RAMCache.h"
+#include "DS1302EventLog.h"
+#include "DS1302Batch.h"
+#include "DS1302Group.h"
+#include "DS1302Scheduler.h"
+#include "DS1302Host.h"
+
+#define EPOCH_2000 ((time_t) 946684800L)
+
+static int failures;
+
+#define CHECK(c) \
+   do { if (!(c)) { printf("line %d: %s\n", __LINE__, #c); failures++; } } while (0)
+
+static void roundTrip(DS1302RTC &rtc, DS1302SimBus &sim)
+ { static const time_t times[] =
+    { EPOCH_2000,                      // 2000-01-01 00:00:00
+      EPOCH_2000 + 59 * SECS_PER_DAY,  // 2000-02-29, a leap day
+      1709251199,                      // 2024-02-29 23:59:59
+      4102444799UL                     // 2099-12-31 23:59:59
+    };
+   tmElements_t tm;
+   uint8_t i;
+
+   for (i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+    { CHECK(rtc.set(times[i]));
+      CHECK(rtc.getEpoch() == times[i]);
+      CHECK(rtc.read(tm) && makeTime(tm) == times[i]);
+      CHECK(rtc.write(tm) && rtc.getEpoch() == times[i]);
+    }
+
+   // 2099-12-31 23:59:59 rolls over to 2000 on the chip.
+   sim.tick();
+   CHECK(rtc.getEpoch() == EPOCH_2000);
+
+   // Outside 2000-2099 nothing is written.
+   CHECK(!rtc.set(EPOCH_2000 - 1));
+   CHECK(!rtc.set(4102444800UL));
+   CHECK(rtc.getEpoch() == EPOCH_2000);
+
+   CHECK(rtc.setHMS(13, 14, 15));
+   CHECK(rtc.getEpoch() == EPOCH_2000 + 13 * 3600 + 14 * 60 + 15);
+   CHECK(!rtc.setHMS(24, 0, 0));
+   CHECK(!rtc.setSeconds(60));
+   CHECK(rtc.getEpoch() == EPOCH_2000 + 13 * 3600 + 14 * 60 + 15);
+ }
+
+static void hourFormat(DS1302RTC &rtc, DS1302SimBus &sim)
+ { tmElements_t tm;
+
+   CHECK(rtc.set(EPOCH_2000));
+
+   // 12 hour format: bit 7, bit 5 is PM, hours 1-12
+   sim.clock[2] = 0x80 | 0x12;         // 12 AM
+   CHECK(rtc.read(tm) && tm.Hour == 0);
+   sim.clock[2] = 0x80 | 0x20 | 0x12;  // 12 PM
+   CHECK(rtc.read(tm) && tm.Hour == 12);
+   sim.clock[2] = 0x80 | 0x20 | 0x01;  // 1 PM
+   CHECK(rtc.read(tm) && tm.Hour == 13);
+   sim.clock[2] = 0x80 | 0x20 | 0x11;  // 11 PM
+   CHECK(rtc.getEpoch() == EPOCH_2000 + 23 * 3600);
+
+   // 11:59:59 PM goes on to 12 AM of the next day.
+   sim.clock[1] = 0x59;
+   sim.clock[0] = 0x59;
+   sim.tick();
+   CHECK(sim.clock[2] == (0x80 | 0x12));
+   CHECK(rtc.getEpoch() == EPOCH_2000 + SECS_PER_DAY);
+
+   // A write goes back to the 24 hour format.
+   CHECK(rtc.setHMS(13, 0, 0));
+   CHECK(sim.clock[2] == 0x13);
+ }
+
+static void writeProtect(DS1302RTC &rtc, DS1302SimBus &sim)
+ { uint8_t data[4] = { 1, 2, 3, 4 };
+
+   rtc.setWriteProtect(true);
+   CHECK(sim.clock[7] & 0x80);
+
+   // The writes clear it for a moment, and set it again.
+   CHECK(rtc.set(EPOCH_2000 + 100));
+   CHECK(rtc.getEpoch() == EPOCH_2000 + 100);
+   CHECK(sim.clock[7] & 0x80);
+   CHECK(rtc.writeRAM(data, 10, 4));
+   CHECK(memcmp(sim.ram + 10, data, 4) == 0);
+   CHECK(sim.clock[7] & 0x80);
+   CHECK(rtc.setTrickleCharger(1, 2));
+   CHECK(sim.clock[7] & 0x80);
+
+   rtc.setWriteProtect(false);
+   CHECK(!(sim.clock[7] & 0x80));
+
+   // The chip refuses a write while it is set.
+   sim.clock[7] = 0x80;
+   sim.ram[0] = 0;
+   sim.start();                        // ram 0, through the bus
+   sim.togglewrite(DS1302_RAMSTART, false);
+   sim.togglewrite(0x77, false);
+   sim.stop();
+   CHECK(sim.ram[0] == 0);
+   sim.clock[7] = 0;
+ }
+
+static void ramBursts(DS1302RTC &rtc, DS1302SimBus &sim)
+ { uint8_t data[DS1302_RAMSIZE], back[DS1302_RAMSIZE];
+   uint8_t i;
+
+   for (i = 0; i < DS1302_RAMSIZE; i++)
+      data[i] = 0xA0 + i;
+
+   // The whole ram is one session each way.
+   sim.clearCounters();
+   CHECK(rtc.writeRAM(data, 0, DS1302_RAMSIZE));
+   CHECK(sim.counters.sessions == 1);
+   CHECK(memcmp(sim.ram, data, DS1302_RAMSIZE) == 0);
+
+   memset(back, 0, sizeof(back));
+   sim.clearCounters();
+   CHECK(rtc.readRAM(back, 0, DS1302_RAMSIZE));
+   CHECK(sim.counters.sessions == 1);
+   CHECK(memcmp(back, data, DS1302_RAMSIZE) == 0);
+
+   // A part of the ram leaves the rest as it is.
+   memset(data, 0x55, 5);
+   CHECK(rtc.writeRAM(data, 26, 5));
+   CHECK(sim.ram[25] == 0xA0 + 25 && sim.ram[26] == 0x55 && sim.ram[30] == 0x55);
+   CHECK(rtc.readRAM(back, 24, 7));
+   CHECK(back[1] == 0xA0 + 25 && back[2] == 0x55);
+
+   CHECK(!rtc.writeRAM(data, 27, 5));
+   CHECK(!rtc.readRAM(back, 31, 1));
+ }
+
+// The time of the simulated chip.
+static time_t chipTime(DS1302SimBus &sim)
+ { return DS1302RTC::epoch(sim.clock);
+ }
+
+static void cachedNow(DS1302RTC &rtc, DS1302SimBus &sim)
+ { uint16_t i;
+   time_t t;
+   bool inRange = true;
+
+   CHECK(rtc.set(EPOCH_2000));
+   hostAttach(&sim);
+   rtc.setCache(10000);
+
+   // 1000 calls in 10 seconds: the first read, the check of the
+   // first second boundary, and the resync after 10 seconds.
+   sim.clearCounters();
+   for (i = 0; i < 1000; i++)
+    { t = rtc.now();
+      if (t > chipTime(sim) || t + 1 < chipTime(sim))
+         inRange = false;
+      hostAdvance(10000);
+    }
+   CHECK(inRange);
+   CHECK(sim.counters.sessions <= 4);
+
+   rtc.setCache(0);
+   hostAttach(0);
+ }
+
+static void ramCache(DS1302RTC &rtc, DS1302SimBus &sim)
+ { DS1302RAMCache ram(rtc);
+   uint8_t back[4], data[4] = { 1, 2, 3, 4 };
+
+   memset(sim.ram, 0, DS1302_RAMSIZE);
+   sim.clearCounters();
+   CHECK(ram.load());
+   CHECK(sim.counters.sessions == 1);
+
+   // Reads and writes don't use the bus, flush() writes
+   // the dirty range as one burst.
+   sim.clearCounters();
+   ram.write(3, 1);
+   ram.write(5, 2);
+   CHECK(ram.read(3) == 1 && ram.dirty());
+   CHECK(sim.counters.sessions == 0);
+   CHECK(ram.flush() && !ram.dirty());
+   CHECK(sim.ram[3] == 1 && sim.ram[5] == 2);
+   CHECK(sim.counters.sessions <= 2);
+
+   // A byte that doesn't change is not dirty.
+   ram.write(3, 1);
+   CHECK(!ram.dirty());
+
+   CHECK(ram.read(31) == 0);
+   CHECK(!ram.read(back, 28, 4));
+   CHECK(ram.read(back, 27, 4));
+
+   // An out of range burst write changes nothing.
+   CHECK(!ram.write(data, 28, 4));
+   CHECK(!ram.write(data, 254, 4));
+   CHECK(ram.read(28) == 0 && ram.read(0) == 0 && !ram.dirty());
+   CHECK(ram.write(data, 27, 4) && ram.read(30) == 4);
+ }
+
+static void eventLog(DS1302RTC &rtc, DS1302SimBus &sim)
+ { DS1302RAMCache ram(rtc);
+   DS1302EventLog log(ram, 0, 16);     // a ring of 11 bytes
+   time_t t[16];
+   uint8_t i, n;
+   bool ordered = true;
+
+   memset(sim.ram, 0, DS1302_RAMSIZE);
+   CHECK(ram.load());
+   CHECK(!log.begin());                // empty ram, cleared
+
+   // One byte per time stamp, the ring keeps the last 10.
+   // An append writes the new byte, the head and a dropped byte.
+   for (i = 1; i <= 30; i++)
+    { sim.clearCounters();
+      CHECK(log.append(EPOCH_2000 + 10 * i));
+      CHECK(sim.counters.sessions <= 3);
+    }
+   CHECK(log.count() == 10);
+   CHECK(log.last() == EPOCH_2000 + 300);
+   n = log.read(t, 16);
+   CHECK(n == 10 && t[0] == EPOCH_2000 + 210);
+   for (i = 0; i < n; i++)
+      if (t[i] != EPOCH_2000 + 210 + 10 * i)
+         ordered = false;
+   CHECK(ordered);
+
+   // A difference of several bytes drops more of the oldest.
+   CHECK(log.append(EPOCH_2000 + 300 + 100000));
+   CHECK(log.count() == 8);
+
+   // From the chip again.
+   DS1302RAMCache ram2(rtc);
+   DS1302EventLog log2(ram2, 0, 16);
+
+   CHECK(ram2.load() && log2.begin());
+   CHECK(log2.count() == 8);
+   CHECK(log2.last() == EPOCH_2000 + 300 + 100000);
+   CHECK(log2.read(t, 1) == 1 && t[0] == EPOCH_2000 + 240);
+
+   // Too small for a log.
+   DS1302EventLog tiny(ram2, 26, 10);
+   CHECK(!tiny.begin() && !tiny.append(EPOCH_2000));
+ }
+
+static void batch(DS1302RTC &rtc, DS1302SimBus &sim)
+ { DS1302Batch b(rtc);
+   uint8_t regs[8], data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+   CHECK(rtc.set(EPOCH_2000));
+   rtc.setWriteProtect(true);
+   memcpy(regs, sim.clock, 8);
+   regs[1] = 0x42;                     // 00:42:00
+
+   // Clear the Write Protect, trickle, ram, and the clock
+   // burst that sets the Write Protect again.
+   sim.clearCounters();
+   b.write(DS1302_TRICKLE, 0xA6).ramBurstWrite(data, 8).clockBurstWrite(regs);
+   CHECK(b.commit());
+   CHECK(sim.counters.sessions == 4);
+   CHECK(sim.trickle == 0xA6 && memcmp(sim.ram, data, 8) == 0);
+   CHECK(rtc.getEpoch() == EPOCH_2000 + 42 * 60);
+   CHECK(sim.clock[7] & 0x80);
+
+   // A known trickle value writes nothing, not even the
+   // Write Protect.
+   sim.clearCounters();
+   b.write(DS1302_TRICKLE, 0xA6);
+   CHECK(b.commit());
+   CHECK(sim.counters.sessions == 0);
+
+   rtc.setWriteProtect(false);
+ }
+
+// A chip that gains a second every hour, synced every hour.
+// The corrected time is the reference, also right after the
+// sync that steps the chip.
+static void drift(DS1302RTC &rtc, DS1302SimBus &sim)
+ { time_t reference;
+   uint8_t hour;
+   uint16_t i;
+   bool exact = true, close = true;
+
+   CHECK(rtc.set(EPOCH_2000));
+   reference = EPOCH_2000;
+   CHECK(rtc.syncTo(reference));
+   for (hour = 1; hour <= 8; hour++)
+    { for (i = 0; i < 3600; i++)
+       { sim.tick();
+         reference++;
+         if (i == 1800 && (rtc.now() > reference + 1 || rtc.now() + 1 < reference))
+            close = false;
+       }
+      sim.tick();                      // the gain
+
+      CHECK(rtc.syncTo(reference));
+      if (rtc.now() != reference)
+         exact = false;
+    }
+   CHECK(exact && close);
+   CHECK(rtc.drift() > 277000 && rtc.drift() < 278000);
+   CHECK(chipTime(sim) != reference + 8);   // stepped on the way
+ }
+
+// A non-blocking read owns the bus until it is done,
+// also against another chip on the same lines.
+static void asyncRead(DS1302RTC &rtc, DS1302SimBus &sim)
+ { DS1302SimBus sim2;
+   DS1302RTC other(sim2);
+   tmElements_t tm;
+   uint8_t polls = 0;
+
+   CHECK(rtc.set(EPOCH_2000 + 5));
+   CHECK(other.set(EPOCH_2000 + 7));
+   sim.clearCounters();
+   sim2.clearCounters();
+
+   CHECK(rtc.beginRead());
+   CHECK(!rtc.beginRead() && !other.beginRead());
+   CHECK(rtc.getEpoch() == 0 && other.getEpoch() == 0);
+   CHECK(sim2.counters.sessions == 0);
+   while (!rtc.poll())
+      polls++;
+   CHECK(polls == 8);
+   CHECK(rtc.result(tm) && makeTime(tm) == EPOCH_2000 + 5);
+   CHECK(sim.counters.sessions == 1);
+
+   CHECK(other.getEpoch() == EPOCH_2000 + 7);
+ }
+
+// A chip with a bad month is not in the mask.
+static void group(DS1302RTC &rtc)
+ { DS1302SimBus sim2;
+   DS1302RTC other(sim2);
+   DS1302RTC *chips[] = { &other, &rtc };
+   DS1302Group group(chips, 2);
+   time_t t[2];
+   tmElements_t tm[2];
+
+   CHECK(rtc.set(EPOCH_2000 + 5));
+   CHECK(other.set(EPOCH_2000 + 7));
+   CHECK(group.read(t) == 3 && t[0] == EPOCH_2000 + 7);
+
+   sim2.clock[4] = 0x13;
+   CHECK(group.read(t) == 2 && t[0] == 0 && t[1] >= EPOCH_2000 + 5);
+   CHECK(group.read(tm) == 2);
+ }
+
+static uint8_t fired;
+static bool onTime;
+static DS1302SimBus *firedSim;
+
+static void onEvent(time_t t)
+ { fired++;
+   if (chipTime(*firedSim) != t)
+      onTime = false;
+ }
+
+// 10 events, 3 seconds apart, with run() every millisecond.
+static uint32_t schedule(DS1302RTC &rtc, DS1302SimBus &sim, uint32_t cache)
+ { DS1302Scheduler scheduler(rtc);
+   uint32_t i;
+
+   CHECK(rtc.set(EPOCH_2000));
+   hostAttach(&sim);
+   rtc.setCache(cache);
+   fired = 0;
+   onTime = true;
+   firedSim = &sim;
+
+   scheduler.at(EPOCH_2000 + 3, onEvent, 3);
+   sim.clearCounters();
+   for (i = 0; i < 30000 + 100; i++)
+    { scheduler.run();
+      hostAdvance(1000);
+    }
+   CHECK(fired == 10 && onTime);
+
+   rtc.setCache(0);
+   hostAttach(0);
+   return sim.counters.sessions;
+ }
+
+// The first event polls for the rollover, the next ones
+// use the edge that was seen then, a read per event.
+static void scheduler(DS1302RTC &rtc, DS1302SimBus &sim)
+ { CHECK(schedule(rtc, sim, 10000) <= 10 + 20 + 3);
+   CHECK(schedule(rtc, sim, 0) <= 10 + 20 + 3);
+ }
+
+int main()
+ { DS1302SimBus sim;
+   DS1302RTC rtc(sim);
+
+   CHECK(rtc.begin());
+   roundTrip(rtc, sim);
+   hourFormat(rtc, sim);
+   writeProtect(rtc, sim);
+   ramBursts(rtc, sim);
+   cachedNow(rtc, sim);
+   ramCache(rtc, sim);
+   eventLog(rtc, sim);
+   batch(rtc, sim);
+   scheduler(rtc, sim);
+   drift(rtc, sim);
+   asyncRead(rtc, sim);
+   group(rtc);
+
+   printf("%s, %d failed\n", failures ? "FAIL" : "OK", failures);
+   return failures ? 1 : 0;
+ }
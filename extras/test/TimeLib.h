@@ -0,0 +1,52 @@
+/*
+ * TimeLib.h - the part of the Time library the host build needs
+ *
+ * Only for the host test, a board uses the real Time library.
+ */
+
+#ifndef TimeLib_h
+#define TimeLib_h
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+ { uint8_t Second;
+   uint8_t Minute;
+   uint8_t Hour;
+   uint8_t Wday;              // day of week, sunday is day 1
+   uint8_t Day;
+   uint8_t Month;
+   uint8_t Year;              // offset from 1970
+ } tmElements_t;
+
+#define SECS_PER_DAY 86400UL
+
+static inline void breakTime(time_t t, tmElements_t &tm)
+ { struct tm r;
+
+   gmtime_r(&t, &r);
+   tm.Second = r.tm_sec;
+   tm.Minute = r.tm_min;
+   tm.Hour = r.tm_hour;
+   tm.Wday = r.tm_wday + 1;
+   tm.Day = r.tm_mday;
+   tm.Month = r.tm_mon + 1;
+   tm.Year = r.tm_year - 70;
+ }
+
+static inline time_t makeTime(const tmElements_t &tm)
+ { struct tm r;
+
+   memset(&r, 0, sizeof(r));
+   r.tm_sec = tm.Second;
+   r.tm_min = tm.Minute;
+   r.tm_hour = tm.Hour;
+   r.tm_mday = tm.Day;
+   r.tm_mon = tm.Month - 1;
+   r.tm_year = tm.Year + 70;
+   return timegm(&r);
+ }
+
+#endif